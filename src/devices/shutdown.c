@@ -5,10 +5,20 @@
 #include "devices/serial.h"
 #include "devices/timer.h"
 #include "threads/io.h"
+#include "threads/allocstat.h"
+#include "threads/lockstat.h"
+#include "threads/palloc.h"
+#include "threads/shrinker.h"
+#include "threads/slab.h"
 #include "threads/thread.h"
 #ifdef USERPROG
 #include "userprog/exception.h"
 #endif
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/page.h"
+#include "vm/swap.h"
+#endif
 #ifdef FILESYS
 #include "devices/block.h"
 #include "filesys/filesys.h"
@@ -121,6 +131,11 @@ print_stats (void)
 {
   timer_print_stats ();
   thread_print_stats ();
+  lockstat_print_stats ();
+  palloc_print_stats ();
+  kmem_print_stats ();
+  shrinker_print_stats ();
+  allocstat_print_stats ();
 #ifdef FILESYS
   block_print_stats ();
 #endif
@@ -129,4 +144,9 @@ print_stats (void)
 #ifdef USERPROG
   exception_print_stats ();
 #endif
+#ifdef VM
+  page_print_stats ();
+  frame_print_stats ();
+  swap_print_stats ();
+#endif
 }
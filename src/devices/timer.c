@@ -20,11 +20,44 @@
 /* Number of timer ticks since OS booted. */
 static int64_t ticks;
 
+/* Tickless idle.  If true, the idle thread stops the periodic
+   tick by programming the PIT for a single interrupt at the
+   next timer event (see timer_idle_enter()), and the ticks it
+   slept through are accounted afterward.
+   Controlled by kernel command-line option "-tickless". */
+bool timer_tickless;
+
+/* PIT cycles per timer tick. */
+#define TICK_COUNT ((PIT_HZ + TIMER_FREQ / 2) / TIMER_FREQ)
+
+/* Longest one-shot interval, in ticks, that fits in the PIT's
+   16-bit counter. */
+#define ONESHOT_MAX_TICKS (65535 / TICK_COUNT)
+
+/* While the PIT is in one-shot mode: the number of ticks the
+   one-shot interrupt stands for, the PIT count it was programmed
+   with, and the part of that count up to the first tick boundary,
+   which need not be a whole tick.  ONESHOT_TICKS is 0 in periodic
+   mode. */
+static int64_t oneshot_ticks;
+static uint16_t oneshot_count;
+static uint16_t oneshot_first;
+static int64_t skipped_ticks;   /* # of ticks without an interrupt. */
+
+/* Pending timer events, ordered by expiration tick.  The timer
+   interrupt only has to look at the root to find out whether
+   anything is due. */
+static struct heap event_heap;
+
+/* Sequence number for the next timer event scheduled. */
+static unsigned next_event_seq;
+
 /* Number of loops per timer tick.
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
 
 static intr_handler_func timer_interrupt;
+static heap_less_func event_less;
 static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
@@ -35,6 +68,7 @@ static void real_time_delay (int64_t num, int32_t denom);
 void
 timer_init (void) 
 {
+  heap_init (&event_heap, event_less, NULL);
   pit_configure_channel (0, 2, TIMER_FREQ);
   intr_register_ext (0x20, timer_interrupt, "8254 Timer");
 }
@@ -178,26 +212,229 @@ void
 timer_print_stats (void) 
 {
   printf ("Timer: %"PRId64" ticks\n", timer_ticks ());
+  if (timer_tickless)
+    printf ("Timer: %"PRId64" ticks skipped by tickless idle\n",
+            skipped_ticks);
+}
+
+/* Called by the idle thread, with interrupts off, just before it
+   halts the CPU.  In tickless mode, if no timer event is due in
+   the next tick, replaces the periodic tick by a single PIT
+   interrupt at the next event (or as far ahead as the PIT can
+   count), keeping the phase of the current tick. */
+void
+timer_idle_enter (void)
+{
+  int64_t deadline, idle_ticks;
+  uint16_t remaining;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!timer_tickless || oneshot_ticks != 0)
+    return;
+
+  deadline = timer_next_event ();
+
+  /* The MLFQS load average is sampled once a second. */
+  if (thread_mlfqs)
+    {
+      int64_t second = (ticks / TIMER_FREQ + 1) * TIMER_FREQ;
+      if (second < deadline)
+        deadline = second;
+    }
+
+  idle_ticks = deadline - ticks;
+  if (idle_ticks < 2)
+    return;
+  if (idle_ticks > ONESHOT_MAX_TICKS)
+    idle_ticks = ONESHOT_MAX_TICKS;
+
+  /* The current tick is partly over: finish it, then count
+     whole ticks. */
+  remaining = pit_read_count (0);
+  if (remaining == 0 || remaining > TICK_COUNT)
+    return;
+  oneshot_first = remaining;
+  oneshot_count = remaining + (idle_ticks - 1) * TICK_COUNT;
+  oneshot_ticks = idle_ticks;
+  pit_start_oneshot (0, oneshot_count);
+}
+
+/* Called by the scheduler, with interrupts off, when the idle
+   thread stops running.  If an interrupt other than the timer
+   woke the CPU before the one-shot interrupt, accounts the whole
+   ticks that have gone by and arranges for the periodic tick to
+   resume at the next tick boundary.  Returns the number of ticks
+   accounted, which were all spent idle. */
+int64_t
+timer_idle_exit (void)
+{
+  uint16_t remaining, elapsed;
+  int64_t whole;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (oneshot_ticks == 0)
+    return 0;
+
+  /* If the counter already ran out, the timer interrupt is
+     pending and will do the accounting. */
+  remaining = pit_read_count (0);
+  if (remaining == 0 || remaining > oneshot_count)
+    return 0;
+
+  /* The first tick boundary came ONESHOT_FIRST counts in, and
+     the rest are TICK_COUNT apart. */
+  elapsed = oneshot_count - remaining;
+  whole = elapsed >= oneshot_first
+          ? (elapsed - oneshot_first) / TICK_COUNT + 1 : 0;
+  ticks += whole;
+  skipped_ticks += whole;
+
+  /* One more interrupt at the next tick boundary restores the
+     periodic tick. */
+  oneshot_count = oneshot_first + whole * TICK_COUNT - elapsed;
+  oneshot_first = oneshot_count;
+  oneshot_ticks = 1;
+  pit_start_oneshot (0, oneshot_count);
+
+  return whole;
 }
 
-/* Timer interrupt handler. */
+/* Initializes timer event EVENT to call FUNC with AUX when it
+   expires.  EVENT is not scheduled. */
+void
+timer_event_init (struct timer_event *event, timer_func *func, void *aux)
+{
+  ASSERT (event != NULL);
+  ASSERT (func != NULL);
+
+  event->expires = 0;
+  event->seq = 0;
+  event->pending = false;
+  event->func = func;
+  event->aux = aux;
+}
+
+/* Schedules EVENT to run when the timer tick count reaches
+   EXPIRES, an absolute tick as returned by timer_ticks().  If
+   EXPIRES has already passed, EVENT runs at the next tick.  If
+   EVENT is already pending, it is rescheduled.
+
+   This function may be called from an interrupt handler,
+   including from a timer event's own function. */
+void
+timer_event_schedule (struct timer_event *event, int64_t expires)
+{
+  enum intr_level old_level;
+
+  ASSERT (event != NULL);
+
+  old_level = intr_disable ();
+  if (event->pending)
+    heap_remove (&event_heap, &event->elem);
+  event->expires = expires;
+  event->seq = next_event_seq++;
+  event->pending = true;
+  heap_insert (&event_heap, &event->elem);
+  intr_set_level (old_level);
+}
+
+/* Cancels EVENT.  Returns true if it was pending, false if it
+   had already run or was never scheduled. */
+bool
+timer_event_cancel (struct timer_event *event)
+{
+  enum intr_level old_level;
+  bool was_pending;
+
+  ASSERT (event != NULL);
+
+  old_level = intr_disable ();
+  was_pending = event->pending;
+  if (was_pending)
+    {
+      heap_remove (&event_heap, &event->elem);
+      event->pending = false;
+    }
+  intr_set_level (old_level);
+
+  return was_pending;
+}
+
+/* Returns the tick at which the earliest pending timer event
+   expires, or INT64_MAX if no event is pending. */
+int64_t
+timer_next_event (void)
+{
+  enum intr_level old_level = intr_disable ();
+  int64_t next = INT64_MAX;
+
+  if (!heap_empty (&event_heap))
+    next = heap_entry (heap_min (&event_heap), struct timer_event,
+                       elem)->expires;
+  intr_set_level (old_level);
+
+  return next;
+}
+
+/* Runs every timer event that has expired by tick NOW.  Takes
+   constant time when nothing is due. */
 static void
-timer_interrupt (struct intr_frame *args UNUSED)
+run_expired_events (int64_t now)
 {
-  ticks++;
-  thread_tick ();
+  while (!heap_empty (&event_heap))
+    {
+      struct timer_event *event = heap_entry (heap_min (&event_heap),
+                                              struct timer_event, elem);
+      if (event->expires > now)
+        break;
+
+      heap_pop_min (&event_heap);
+      event->pending = false;
+      event->func (event->aux);
+    }
+}
 
-  thread_wake_up(ticks);
+/* Orders timer events by expiration tick, then by the order in
+   which they were scheduled. */
+static bool
+event_less (const struct heap_elem *a_, const struct heap_elem *b_,
+            void *aux UNUSED)
+{
+  const struct timer_event *a = heap_entry (a_, struct timer_event, elem);
+  const struct timer_event *b = heap_entry (b_, struct timer_event, elem);
 
-  // // check global tick
-  // int64_t global_tick;
-  // global_tick = get_global_tick();
+  if (a->expires != b->expires)
+    return a->expires < b->expires;
+  return (int) (a->seq - b->seq) < 0;
+}
 
-  // // if min tick of local ticks of thread <= now time tick
-  // if (global_tick <= ticks) {  
-  //     // there are some thread to wake up
-  //     thread_wake_up (ticks);
-  // }
+/* Timer interrupt handler. */
+static void
+timer_interrupt (struct intr_frame *args UNUSED)
+{
+  if (oneshot_ticks == 0)
+    {
+      ticks++;
+      thread_tick ();
+    }
+  else 
+    {
+      /* End of a tickless idle period: go back to the periodic
+         tick and run the ticks we slept through. */
+      int64_t i;
+
+      pit_configure_channel (0, 2, TIMER_FREQ);
+      skipped_ticks += oneshot_ticks - 1;
+      for (i = 0; i < oneshot_ticks; i++)
+        {
+          ticks++;
+          thread_tick ();
+        }
+      oneshot_ticks = 0;
+    }
+  run_expired_events (ticks);
 }
 
 /* Returns true if LOOPS iterations waits for more than one timer
@@ -1,7 +1,9 @@
 #ifndef DEVICES_TIMER_H
 #define DEVICES_TIMER_H
 
+#include <heap.h>
 #include <round.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 /* Number of timer interrupts per second. */
@@ -26,4 +28,31 @@ void timer_ndelay (int64_t nanoseconds);
 
 void timer_print_stats (void);
 
+/* Tickless idle. */
+extern bool timer_tickless;
+void timer_idle_enter (void);
+int64_t timer_idle_exit (void);
+
+/* Kernel timers. */
+typedef void timer_func (void *aux);
+
+/* A kernel timer event.  Once scheduled, FUNC is called with
+   AUX from the timer interrupt handler as soon as the timer
+   tick count reaches EXPIRES.  The callback runs in external
+   interrupt context, so it must not sleep. */
+struct timer_event
+  {
+    struct heap_elem elem;      /* Element in the pending event heap. */
+    int64_t expires;            /* Tick at which to run FUNC. */
+    unsigned seq;               /* Orders events with equal EXPIRES. */
+    bool pending;               /* Scheduled but not yet run? */
+    timer_func *func;           /* Function to call. */
+    void *aux;                  /* Auxiliary data for FUNC. */
+  };
+
+void timer_event_init (struct timer_event *, timer_func *, void *aux);
+void timer_event_schedule (struct timer_event *, int64_t expires);
+bool timer_event_cancel (struct timer_event *);
+int64_t timer_next_event (void);
+
 #endif /* devices/timer.h */
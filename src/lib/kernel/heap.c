@@ -0,0 +1,175 @@
+#include "heap.h"
+#include "../debug.h"
+
+/* Pairing heap.  See heap.h for basic information.
+
+   Each element's children form a doubly linked sibling list
+   through `next' and `prev'.  The leftmost child's `prev'
+   points to its parent instead, which is how heap_remove()
+   tells the two cases apart.  The root has null `next' and
+   `prev'. */
+
+static struct heap_elem *meld (struct heap *,
+                               struct heap_elem *, struct heap_elem *);
+static struct heap_elem *merge_pairs (struct heap *, struct heap_elem *);
+
+/* Initializes H as an empty heap that orders its elements
+   using LESS, given auxiliary data AUX. */
+void
+heap_init (struct heap *h, heap_less_func *less, void *aux)
+{
+  ASSERT (h != NULL);
+  ASSERT (less != NULL);
+
+  h->root = NULL;
+  h->size = 0;
+  h->less = less;
+  h->aux = aux;
+}
+
+/* Inserts E into H.  E must not already be in a heap. */
+void
+heap_insert (struct heap *h, struct heap_elem *e)
+{
+  ASSERT (h != NULL);
+  ASSERT (e != NULL);
+
+  e->child = e->next = e->prev = NULL;
+  h->root = h->root != NULL ? meld (h, h->root, e) : e;
+  h->size++;
+}
+
+/* Returns the least element in H.  H must not be empty. */
+struct heap_elem *
+heap_min (const struct heap *h)
+{
+  ASSERT (!heap_empty (h));
+  return h->root;
+}
+
+/* Removes the least element from H and returns it.  H must not
+   be empty. */
+struct heap_elem *
+heap_pop_min (struct heap *h)
+{
+  struct heap_elem *min = heap_min (h);
+
+  h->root = merge_pairs (h, min->child);
+  h->size--;
+  min->child = NULL;
+  return min;
+}
+
+/* Removes E, which must be in H, from H. */
+void
+heap_remove (struct heap *h, struct heap_elem *e)
+{
+  struct heap_elem *sub;
+
+  ASSERT (!heap_empty (h));
+  ASSERT (e != NULL);
+
+  if (e == h->root)
+    {
+      heap_pop_min (h);
+      return;
+    }
+
+  /* Unlink E, along with its subtree, from its sibling list. */
+  ASSERT (e->prev != NULL);
+  if (e->prev->child == e)
+    e->prev->child = e->next;
+  else
+    e->prev->next = e->next;
+  if (e->next != NULL)
+    e->next->prev = e->prev;
+  e->next = e->prev = NULL;
+
+  /* Put E's children back into the heap. */
+  sub = merge_pairs (h, e->child);
+  e->child = NULL;
+  if (sub != NULL)
+    h->root = meld (h, h->root, sub);
+  h->size--;
+}
+
+/* Returns the number of elements in H. */
+size_t
+heap_size (const struct heap *h)
+{
+  return h->size;
+}
+
+/* Returns true if H is empty, false otherwise. */
+bool
+heap_empty (const struct heap *h)
+{
+  return h->root == NULL;
+}
+
+/* Melds the heaps rooted at A and B, which must both be roots
+   (no siblings, no parent), and returns the new root.  On a tie,
+   A stays on top. */
+static struct heap_elem *
+meld (struct heap *h, struct heap_elem *a, struct heap_elem *b)
+{
+  if (h->less (b, a, h->aux))
+    {
+      struct heap_elem *t = a;
+      a = b;
+      b = t;
+    }
+
+  /* Make B the leftmost child of A. */
+  b->prev = a;
+  b->next = a->child;
+  if (a->child != NULL)
+    a->child->prev = b;
+  a->child = b;
+  return a;
+}
+
+/* Combines the sibling list starting at FIRST into a single
+   heap, using the standard two-pass pairing, and returns its
+   root, or a null pointer if FIRST is null. */
+static struct heap_elem *
+merge_pairs (struct heap *h, struct heap_elem *first)
+{
+  struct heap_elem *pairs = NULL;
+  struct heap_elem *root = NULL;
+
+  /* First pass: meld siblings pairwise, left to right, pushing
+     each result onto a stack linked through `next'. */
+  while (first != NULL)
+    {
+      struct heap_elem *a = first;
+      struct heap_elem *b = a->next;
+      struct heap_elem *m;
+
+      if (b != NULL)
+        {
+          first = b->next;
+          a->next = a->prev = b->next = b->prev = NULL;
+          m = meld (h, a, b);
+        }
+      else
+        {
+          first = NULL;
+          a->next = a->prev = NULL;
+          m = a;
+        }
+      m->next = pairs;
+      pairs = m;
+    }
+
+  /* Second pass: meld the pairs right to left. */
+  while (pairs != NULL)
+    {
+      struct heap_elem *p = pairs;
+      pairs = p->next;
+      p->next = NULL;
+      root = root != NULL ? meld (h, p, root) : p;
+    }
+
+  return root;
+}
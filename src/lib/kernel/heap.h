@@ -0,0 +1,75 @@
+#ifndef __LIB_KERNEL_HEAP_H
+#define __LIB_KERNEL_HEAP_H
+
+/* Priority queue.
+
+   This is a pairing heap.  Like the list and hash table
+   implementations, it does not use dynamic allocation: each
+   structure that can potentially be in a heap must embed a
+   struct heap_elem member, and the heap_entry macro converts a
+   struct heap_elem back to the structure object that contains
+   it.  Refer to lib/kernel/list.h for a detailed explanation of
+   the technique.
+
+   The element that is "least" according to the heap's
+   heap_less_func is kept at the root, where heap_min() finds it
+   in constant time.  heap_insert() also takes constant time,
+   and heap_pop_min() and heap_remove() take O(lg n) amortized
+   time.  Because no allocation is needed, all of these may be
+   called from an interrupt handler.
+
+   The heap is not stable: elements that compare equal come out
+   in an unspecified order.  Include a sequence number in the
+   comparison if insertion order matters.
+
+   An element whose key changes while it is in a heap must be
+   removed with heap_remove() before the change and reinserted
+   afterward. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Heap element. */
+struct heap_elem
+  {
+    struct heap_elem *child;    /* Leftmost child. */
+    struct heap_elem *next;     /* Next sibling. */
+    struct heap_elem *prev;     /* Previous sibling, or parent. */
+  };
+
+/* Converts pointer to heap element HEAP_ELEM into a pointer to
+   the structure that HEAP_ELEM is embedded inside.  Supply the
+   name of the outer structure STRUCT and the member name MEMBER
+   of the heap element. */
+#define heap_entry(HEAP_ELEM, STRUCT, MEMBER)           \
+        ((STRUCT *) ((uint8_t *) &(HEAP_ELEM)->child    \
+                     - offsetof (STRUCT, MEMBER.child)))
+
+/* Compares the value of two heap elements A and B, given
+   auxiliary data AUX.  Returns true if A should come out of the
+   heap before B. */
+typedef bool heap_less_func (const struct heap_elem *a,
+                             const struct heap_elem *b,
+                             void *aux);
+
+/* Heap. */
+struct heap
+  {
+    struct heap_elem *root;     /* Least element, or null. */
+    size_t size;                /* Number of elements. */
+    heap_less_func *less;       /* Comparison function. */
+    void *aux;                  /* Auxiliary data for `less'. */
+  };
+
+void heap_init (struct heap *, heap_less_func *, void *aux);
+
+void heap_insert (struct heap *, struct heap_elem *);
+struct heap_elem *heap_min (const struct heap *);
+struct heap_elem *heap_pop_min (struct heap *);
+void heap_remove (struct heap *, struct heap_elem *);
+
+size_t heap_size (const struct heap *);
+bool heap_empty (const struct heap *);
+
+#endif /* lib/kernel/heap.h */
@@ -0,0 +1,52 @@
+#ifndef __LIB_SCHED_STATS_H
+#define __LIB_SCHED_STATS_H
+
+#include <stdint.h>
+
+/* Scheduler statistics, shared between the kernel, which prints
+   them at shutdown, and user programs, which read them with the
+   schedstat system call.  All times are in CPU cycles as counted
+   by the time-stamp counter. */
+
+/* Wakeup latency histogram.  Bucket 0 counts latencies under
+   2**SCHED_LAT_SHIFT cycles, and each later bucket B counts those
+   from 2**(SCHED_LAT_SHIFT + B - 1) up to twice that.  The last
+   bucket also counts everything longer. */
+#define SCHED_LAT_SHIFT 10
+#define SCHED_LAT_BUCKETS 16
+
+/* Seconds of run queue length history kept. */
+#define SCHED_RQ_HISTORY 16
+
+/* Context switch and wakeup counters, kept for each thread and
+   for the system as a whole. */
+struct sched_counters
+  {
+    uint64_t voluntary;         /* Switches away from a thread that blocked or exited. */
+    uint64_t involuntary;       /* Switches away from a preempted thread. */
+    uint64_t wakeups;           /* Wakeups that have since run. */
+    uint64_t latency_total;     /* Sum of wakeup-to-run latencies. */
+    uint64_t latency_max;       /* Longest wakeup-to-run latency. */
+    uint32_t latency_hist[SCHED_LAT_BUCKETS];
+  };
+
+struct sched_stats
+  {
+    struct sched_counters all;          /* Every thread since boot. */
+    struct sched_counters thread;       /* The thread asked about. */
+
+    /* Total length of all run queues, sampled every timer tick. */
+    uint64_t rq_samples;                /* # of samples. */
+    uint64_t rq_len_total;              /* Sum of samples. */
+    uint32_t rq_len_max;                /* Largest sample. */
+    uint32_t rq_history[SCHED_RQ_HISTORY]; /* 100 times the average
+                                           over each of the last
+                                           seconds, latest first. */
+
+    /* Time spent in schedule(), which runs with interrupts off. */
+    uint64_t schedule_cnt;              /* # of calls. */
+    uint64_t schedule_cycles;           /* Total time. */
+    uint64_t schedule_cycles_max;       /* Longest call. */
+  };
+
+#endif /* lib/sched-stats.h */
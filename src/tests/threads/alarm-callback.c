@@ -0,0 +1,72 @@
+/* Schedules kernel timer events out of order, cancels one of
+   them, and checks that the rest run in order of expiration, at
+   the tick they were scheduled for. */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define EVENT_CNT 5
+
+static timer_func alarm_callback;
+
+static struct timer_event events[EVENT_CNT];
+static int64_t start_time;
+static int fired[EVENT_CNT];
+static int64_t fired_at[EVENT_CNT];
+static int fired_cnt;
+static struct semaphore done;
+
+void
+test_alarm_callback (void) 
+{
+  static const int delays[EVENT_CNT] = {30, 10, 50, 20, 40};
+  int i;
+
+  sema_init (&done, 0);
+  fired_cnt = 0;
+
+  /* Busy-wait until the current time changes, so that all the
+     events are scheduled within the same tick. */
+  start_time = timer_ticks ();
+  while (timer_elapsed (start_time) == 0)
+    continue;
+  start_time = timer_ticks ();
+
+  for (i = 0; i < EVENT_CNT; i++)
+    {
+      timer_event_init (&events[i], alarm_callback, (void *) i);
+      timer_event_schedule (&events[i], start_time + delays[i]);
+    }
+
+  /* Cancel the event due at +50; the one due at +40 is last. */
+  if (!timer_event_cancel (&events[2]))
+    fail ("pending event could not be canceled");
+  if (timer_event_cancel (&events[2]))
+    fail ("canceled event was still pending");
+
+  sema_down (&done);
+
+  for (i = 0; i < fired_cnt; i++)
+    msg ("event with delay %d ran at tick +%"PRId64".",
+         delays[fired[i]], fired_at[i] - start_time);
+}
+
+/* Records which event ran and when.  Runs in the timer
+   interrupt, so it must not print. */
+static void
+alarm_callback (void *aux) 
+{
+  int idx = (int) aux;
+
+  ASSERT (intr_context ());
+
+  fired[fired_cnt] = idx;
+  fired_at[fired_cnt] = timer_ticks ();
+  if (++fired_cnt == EVENT_CNT - 1)
+    sema_up (&done);
+}
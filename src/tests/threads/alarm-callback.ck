@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(alarm-callback) begin
+(alarm-callback) event with delay 10 ran at tick +10.
+(alarm-callback) event with delay 20 ran at tick +20.
+(alarm-callback) event with delay 30 ran at tick +30.
+(alarm-callback) event with delay 40 ran at tick +40.
+(alarm-callback) end
+EOF
+pass;
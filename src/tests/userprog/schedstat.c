@@ -0,0 +1,25 @@
+/* Reads the scheduler statistics after waiting for a child,
+   which must have blocked this process at least once. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  struct sched_stats s;
+
+  wait (exec ("child-simple"));
+
+  CHECK (schedstat (-1, &s), "schedstat");
+  if (s.thread.voluntary == 0)
+    fail ("no voluntary context switches counted for waiting");
+  if (s.all.voluntary < s.thread.voluntary
+      || s.all.wakeups < s.thread.wakeups)
+    fail ("system-wide counters smaller than this thread's");
+  if (s.schedule_cnt == 0)
+    fail ("no calls to schedule() counted");
+  if (schedstat (12345, &s))
+    fail ("schedstat succeeded for nonexistent pid");
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(schedstat) begin
+(child-simple) run
+child-simple: exit(81)
+(schedstat) schedstat
+(schedstat) end
+schedstat: exit(0)
+EOF
+pass;
@@ -0,0 +1,31 @@
+/* Forks a child that overwrites a page it shares with its
+   parent, and verifies that the parent's copy of the page is
+   unchanged afterward. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[4096];
+
+void
+test_main (void) 
+{
+  pid_t child;
+  size_t i;
+
+  memset (buf, 'p', sizeof buf);
+  child = fork ();
+  if (child == 0)
+    {
+      memset (buf, 'c', sizeof buf);
+      exit (42);
+    }
+  CHECK (child != PID_ERROR && wait (child) == 42,
+         "fork and wait for child (should return 42)");
+
+  for (i = 0; i < sizeof buf; i++)
+    if (buf[i] != 'p')
+      fail ("byte %zu changed to '%c' by child", i, buf[i]);
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(fork-cow) begin
+fork-cow: exit(42)
+(fork-cow) fork and wait for child (should return 42)
+(fork-cow) end
+fork-cow: exit(0)
+EOF
+pass;
@@ -0,0 +1,233 @@
+#include "threads/allocstat.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+
+/* Maximum number of call sites profiled.  Allocations from call
+   sites that find the table full are counted but not
+   attributed. */
+#define ALLOCSTAT_SITES 256
+
+/* Maximum number of live blocks tracked.  Blocks allocated while
+   the table is full are counted against their call site, but
+   their frees cannot be, so they look leaked. */
+#define ALLOCSTAT_LIVE 2048
+
+/* Number of hash buckets for live blocks.  Must be a power of 2. */
+#define ALLOCSTAT_BUCKETS 512
+
+/* Number of call sites in the report. */
+#define ALLOCSTAT_REPORT 10
+
+/* Statistics for one call site. */
+struct allocstat_site
+  {
+    const void *caller;         /* Return address of the call, or null. */
+    enum allocstat_kind kind;   /* Allocator called. */
+    uint64_t allocs;            /* # of blocks allocated. */
+    uint64_t frees;             /* # of those blocks freed. */
+    uint64_t requested;         /* Total bytes requested. */
+    uint64_t allocated;         /* Total bytes actually allocated. */
+    size_t live;                /* Bytes allocated and not yet freed. */
+    size_t peak;                /* Largest value of `live'. */
+    int64_t first_tick;         /* Timer tick of first allocation. */
+  };
+
+/* A live block. */
+struct allocstat_block
+  {
+    const void *block;          /* Address returned to the caller. */
+    struct allocstat_block *next; /* Next in hash chain or free list. */
+    uint16_t site;              /* Index into sites[]. */
+    size_t size;                /* Bytes allocated. */
+  };
+
+/* If true, profile allocations from now on.
+   Controlled by kernel command-line option "-allocstat". */
+bool allocstat_enabled;
+
+static struct allocstat_site sites[ALLOCSTAT_SITES];
+static size_t site_cnt;         /* # of entries in use in sites[]. */
+static uint64_t site_dropped;   /* # of allocations not attributed. */
+
+static struct allocstat_block blocks[ALLOCSTAT_LIVE];
+static struct allocstat_block *buckets[ALLOCSTAT_BUCKETS];
+static struct allocstat_block *free_blocks; /* Unused blocks[] entries. */
+static size_t blocks_used;      /* # of blocks[] entries ever used. */
+static uint64_t block_dropped;  /* # of allocations not tracked. */
+
+/* Returns the hash bucket for address P. */
+static struct allocstat_block **
+bucket (const void *p)
+{
+  uintptr_t x = (uintptr_t) p;
+  return &buckets[((x >> 4) ^ (x >> 13)) & (ALLOCSTAT_BUCKETS - 1)];
+}
+
+/* Returns the site record for CALLER and KIND, creating it if
+   necessary, or a null pointer if the table is full. */
+static struct allocstat_site *
+find_site (enum allocstat_kind kind, const void *caller)
+{
+  uintptr_t x = (uintptr_t) caller;
+  size_t i = (x ^ (x >> 9) ^ kind) % ALLOCSTAT_SITES;
+  size_t probes;
+
+  for (probes = 0; probes < ALLOCSTAT_SITES;
+       probes++, i = (i + 1) % ALLOCSTAT_SITES)
+    {
+      struct allocstat_site *s = &sites[i];
+      if (s->caller == caller && s->kind == kind)
+        return s;
+      if (s->caller == NULL)
+        {
+          s->caller = caller;
+          s->kind = kind;
+          s->first_tick = timer_ticks ();
+          site_cnt++;
+          return s;
+        }
+    }
+  return NULL;
+}
+
+/* Records that CALLER obtained BLOCK, of SIZE bytes, from the
+   allocator of the given KIND, asking for REQUESTED bytes.  A
+   null CALLER stands for one allocator obtaining memory from
+   another to carve its own blocks from, which is not recorded,
+   since those blocks are. */
+void
+allocstat_alloc (enum allocstat_kind kind, const void *caller,
+                 const void *block, size_t requested, size_t size)
+{
+  struct allocstat_site *s;
+  struct allocstat_block *b;
+  enum intr_level old_level;
+
+  if (block == NULL || caller == NULL)
+    return;
+
+  old_level = intr_disable ();
+  s = find_site (kind, caller);
+  if (s == NULL)
+    {
+      site_dropped++;
+      intr_set_level (old_level);
+      return;
+    }
+  s->allocs++;
+  s->requested += requested;
+  s->allocated += size;
+  s->live += size;
+  if (s->live > s->peak)
+    s->peak = s->live;
+
+  if (free_blocks != NULL)
+    {
+      b = free_blocks;
+      free_blocks = b->next;
+    }
+  else if (blocks_used < ALLOCSTAT_LIVE)
+    b = &blocks[blocks_used++];
+  else
+    b = NULL;
+
+  if (b != NULL)
+    {
+      struct allocstat_block **head = bucket (block);
+      b->block = block;
+      b->site = s - sites;
+      b->size = size;
+      b->next = *head;
+      *head = b;
+    }
+  else
+    block_dropped++;
+  intr_set_level (old_level);
+}
+
+/* Records that BLOCK was freed.  Does nothing if BLOCK is not
+   being tracked. */
+void
+allocstat_free (const void *block)
+{
+  struct allocstat_block **bp;
+  enum intr_level old_level;
+
+  if (block == NULL)
+    return;
+
+  old_level = intr_disable ();
+  for (bp = bucket (block); *bp != NULL; bp = &(*bp)->next)
+    if ((*bp)->block == block)
+      {
+        struct allocstat_block *b = *bp;
+        struct allocstat_site *s = &sites[b->site];
+
+        s->frees++;
+        s->live -= b->size;
+        *bp = b->next;
+        b->next = free_blocks;
+        free_blocks = b;
+        break;
+      }
+  intr_set_level (old_level);
+}
+
+/* Prints the ALLOCSTAT_REPORT call sites with the most live
+   bytes, and malloc()'s arena utilization, if profiling is
+   enabled.  Call sites are printed as return addresses, which
+   the "backtrace" utility can turn into function names. */
+void
+allocstat_print_stats (void)
+{
+  bool reported[ALLOCSTAT_SITES];
+  int64_t now;
+  int n;
+
+  if (!allocstat_enabled)
+    return;
+
+  now = timer_ticks ();
+  printf ("Allocstat: %zu call sites", site_cnt);
+  if (site_dropped > 0)
+    printf (", %"PRIu64" allocations not attributed (table full)",
+            site_dropped);
+  if (block_dropped > 0)
+    printf (", %"PRIu64" blocks not tracked (table full)", block_dropped);
+  printf (", top %d by live bytes:\n", ALLOCSTAT_REPORT);
+
+  memset (reported, 0, sizeof reported);
+  for (n = 0; n < ALLOCSTAT_REPORT; n++)
+    {
+      struct allocstat_site *s = NULL;
+      int64_t ticks;
+      size_t i;
+
+      for (i = 0; i < ALLOCSTAT_SITES; i++)
+        if (!reported[i] && sites[i].caller != NULL
+            && (s == NULL || sites[i].live > s->live
+                || (sites[i].live == s->live
+                    && sites[i].allocated > s->allocated)))
+          s = &sites[i];
+      if (s == NULL)
+        break;
+      reported[s - sites] = true;
+
+      ticks = now - s->first_tick;
+      printf ("Allocstat: %s %p: %zu bytes live (peak %zu), "
+              "%"PRIu64" allocs, %"PRIu64" frees, "
+              "%"PRId64" allocs/s, %"PRIu64" of %"PRIu64" bytes unused\n",
+              s->kind == ALLOCSTAT_MALLOC ? "malloc" : "palloc",
+              s->caller, s->live, s->peak, s->allocs, s->frees,
+              ticks > 0 ? (int64_t) s->allocs * TIMER_FREQ / ticks : 0,
+              s->allocated - s->requested, s->allocated);
+    }
+
+  malloc_print_stats ();
+}
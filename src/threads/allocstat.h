@@ -0,0 +1,35 @@
+#ifndef THREADS_ALLOCSTAT_H
+#define THREADS_ALLOCSTAT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Allocation profiler.
+
+   When enabled with the "-allocstat" kernel option, every block
+   obtained from malloc(), calloc(), realloc(), palloc_get_page()
+   or palloc_get_multiple() is tagged with the address its caller
+   returns to, and counted against that call site until it is
+   freed.  The pages that malloc() carves its blocks from are not
+   counted themselves, so that they are not counted twice.
+   allocstat_print_stats() reports the call sites holding the
+   most memory, along with how well malloc() fills its arenas; it
+   runs at shutdown and may also be called at any other time.
+   When disabled, the only cost is a test of allocstat_enabled on
+   each allocation and free. */
+
+/* Kind of allocator. */
+enum allocstat_kind
+  {
+    ALLOCSTAT_MALLOC,           /* malloc() and friends. */
+    ALLOCSTAT_PALLOC            /* Page allocator. */
+  };
+
+extern bool allocstat_enabled;
+
+void allocstat_alloc (enum allocstat_kind, const void *caller,
+                      const void *block, size_t requested, size_t size);
+void allocstat_free (const void *block);
+void allocstat_print_stats (void);
+
+#endif /* threads/allocstat.h */
@@ -0,0 +1,32 @@
+#ifndef THREADS_CPU_H
+#define THREADS_CPU_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Access to CPU facilities that have no C equivalent. */
+
+/* Returns the time-stamp counter, which counts CPU cycles since
+   reset.  See [IA32-v2b] "RDTSC". */
+static inline uint64_t
+cpu_cycles (void)
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+/* CPUID feature bits, in EDX of leaf 1. */
+#define CPUID_PSE (1u << 3)             /* 4 MB pages. */
+#define CPUID_PGE (1u << 13)            /* Global pages. */
+
+/* Returns true if the CPU has all the CPUID_* FEATURES. */
+static inline bool
+cpu_has_feature (uint32_t features)
+{
+  uint32_t eax, ebx, ecx, edx;
+  asm ("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "a" (1));
+  return (edx & features) == features;
+}
+
+#endif /* threads/cpu.h */
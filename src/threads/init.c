@@ -15,17 +15,23 @@
 #include "devices/timer.h"
 #include "devices/vga.h"
 #include "devices/rtc.h"
+#include "threads/allocstat.h"
+#include "threads/cpu.h"
+#include "threads/flags.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
 #include "threads/loader.h"
+#include "threads/lockstat.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/pte.h"
 #include "threads/thread.h"
+#include "threads/vaddr.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #include "userprog/exception.h"
 #include "userprog/gdt.h"
+#include "userprog/pagedir.h"
 #include "userprog/syscall.h"
 #include "userprog/tss.h"
 #else
@@ -37,10 +43,18 @@
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
 #endif
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/page.h"
+#include "vm/swap.h"
+#endif
 
 /* Page directory with kernel mappings only. */
 uint32_t *init_page_dir;
 
+/* True if 4 MB pages may be used. */
+bool init_pse;
+
 #ifdef FILESYS
 /* -f: Format the file system? */
 static bool format_filesys;
@@ -113,6 +127,11 @@ main (void)
 #ifdef USERPROG
   exception_init ();
   syscall_init ();
+  process_init ();
+#endif
+#ifdef VM
+  page_init ();
+  frame_init ();
 #endif
 
   /* Start thread scheduler and enable interrupts. */
@@ -126,6 +145,9 @@ main (void)
   locate_block_devices ();
   filesys_init (format_filesys);
 #endif
+#ifdef VM
+  swap_init ();
+#endif
 
   printf ("Boot complete.\n");
   
@@ -153,14 +175,32 @@ bss_init (void)
 /* Populates the base page directory and page table with the
    kernel virtual mapping, and then sets up the CPU to use the
    new page directory.  Points init_page_dir to the page
-   directory it creates. */
+   directory it creates.
+
+   If the CPU supports it, each 4 MB region of RAM is mapped
+   with a single large page, which saves the page table and
+   covers the region with a single TLB entry.  Regions holding
+   kernel text, which must be read-only, and a partial region at
+   the end of RAM still get a page table.
+
+   If the CPU supports global pages, the kernel mappings are
+   marked global.  They are the same in every page directory, so
+   there is no reason for switching page directories to flush
+   them from the TLB. */
 static void
 paging_init (void)
 {
   uint32_t *pd, *pt;
   size_t page;
+  uint32_t cr4, global;
   extern char _start, _end_kernel_text;
 
+  init_pse = cpu_has_feature (CPUID_PSE);
+  global = cpu_has_feature (CPUID_PGE) ? PTE_G : 0;
+  asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+  if (init_pse)
+    asm volatile ("movl %0, %%cr4" : : "r" (cr4 | CR4_PSE));
+
   pd = init_page_dir = palloc_get_page (PAL_ASSERT | PAL_ZERO);
   pt = NULL;
   for (page = 0; page < init_ram_pages; page++)
@@ -173,11 +213,19 @@ paging_init (void)
 
       if (pd[pde_idx] == 0)
         {
+          if (init_pse && pte_idx == 0
+              && page + LARGE_PAGE_CNT <= init_ram_pages
+              && (vaddr + PTSPAN <= &_start || vaddr >= &_end_kernel_text))
+            {
+              pd[pde_idx] = pde_create_large (vaddr, true) | global;
+              page += LARGE_PAGE_CNT - 1;
+              continue;
+            }
           pt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
           pd[pde_idx] = pde_create (pt);
         }
 
-      pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text);
+      pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text) | global;
     }
 
   /* Store the physical address of the page directory into CR3
@@ -186,6 +234,14 @@ paging_init (void)
      to/from Control Registers" and [IA32-v3a] 3.7.5 "Base Address
      of the Page Directory". */
   asm volatile ("movl %0, %%cr3" : : "r" (vtop (init_page_dir)));
+
+  /* Turn on global pages only now, so that no stale global
+     entries from the loader's page tables linger in the TLB. */
+  if (global)
+    {
+      asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+      asm volatile ("movl %0, %%cr4" : : "r" (cr4 | CR4_PGE));
+    }
 }
 
 /* Breaks the kernel command line into words and returns them as
@@ -256,9 +312,29 @@ parse_options (char **argv)
         random_init (atoi (value));
       else if (!strcmp (name, "-mlfqs"))
         thread_mlfqs = true;
+      else if (!strcmp (name, "-tickless"))
+        timer_tickless = true;
+      else if (!strcmp (name, "-lockstat"))
+        lockstat_enabled = true;
+      else if (!strcmp (name, "-allocstat"))
+        allocstat_enabled = true;
+      else if (!strcmp (name, "-tcache"))
+        thread_cache_size = atoi (value);
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
+      else if (!strcmp (name, "-largepages"))
+        pagedir_large_pages = true;
+#ifdef VM
+      else if (!strcmp (name, "-stack"))
+        {
+          int limit = atoi (value);
+          if (limit < 1 || (uintptr_t) limit >= (uintptr_t) PHYS_BASE / PGSIZE)
+            PANIC ("stack limit %d out of range 1...%"PRIuPTR, limit,
+                   (uintptr_t) PHYS_BASE / PGSIZE - 1);
+          page_stack_limit = limit;
+        }
+#endif
 #endif
       else
         PANIC ("unknown option `%s' (use -h for help)", name);
@@ -379,8 +455,16 @@ usage (void)
 #endif
           "  -rs=SEED           Set random number seed to SEED.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+          "  -tickless          Stop the periodic timer tick while idle.\n"
+          "  -lockstat          Profile lock contention, report at shutdown.\n"
+          "  -allocstat         Profile memory allocation, report at shutdown.\n"
+          "  -tcache=COUNT      Keep up to COUNT exited threads' pages for reuse.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+          "  -largepages        Map big user segments with 4 MB pages.\n"
+#ifdef VM
+          "  -stack=COUNT       Limit each process's stack to COUNT pages.\n"
+#endif
 #endif
           );
   shutdown_power_off ();
@@ -9,4 +9,7 @@
 /* Page directory with kernel mappings only. */
 extern uint32_t *init_page_dir;
 
+/* True if 4 MB pages may be used. */
+extern bool init_pse;
+
 #endif /* threads/init.h */
@@ -0,0 +1,200 @@
+#include "threads/lockstat.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/cpu.h"
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Maximum number of locks profiled.  Locks initialized after the
+   table fills up are not profiled, but are counted. */
+#define LOCKSTAT_CNT 256
+
+/* Number of donors remembered per lock. */
+#define LOCKSTAT_DONORS 4
+
+/* Number of locks in the report printed at shutdown. */
+#define LOCKSTAT_REPORT 10
+
+/* A thread that donated priority to a lock's holder. */
+struct lockstat_donor
+  {
+    tid_t tid;                  /* Donor's tid. */
+    char name[16];              /* Donor's name. */
+    unsigned cnt;               /* Number of donations. */
+  };
+
+/* Statistics for one lock.  Times are in CPU cycles. */
+struct lockstat
+  {
+    const struct lock *lock;    /* Lock profiled. */
+    char name[24];              /* Name given at lock_init(). */
+    uint64_t acquisitions;      /* # of times acquired. */
+    uint64_t contended;         /* # of acquisitions that had to wait. */
+    uint64_t wait_total;        /* Total time spent waiting. */
+    uint64_t wait_max;          /* Longest wait. */
+    uint64_t hold_total;        /* Total time held. */
+    uint64_t hold_max;          /* Longest hold. */
+    uint64_t acquired_at;       /* Cycle count when last acquired. */
+    uint64_t donations;         /* Total # of donations. */
+    struct lockstat_donor donors[LOCKSTAT_DONORS]; /* Top donors. */
+  };
+
+/* If true, profile locks initialized from now on.
+   Controlled by kernel command-line option "-lockstat". */
+bool lockstat_enabled;
+
+static struct lockstat stats[LOCKSTAT_CNT];
+static size_t stat_cnt;         /* # of entries in use in stats[]. */
+static unsigned dropped_cnt;    /* # of locks that found stats[] full. */
+
+/* Starts profiling LOCK under NAME, if profiling is enabled.  A
+   leading `&', left over when NAME is the stringized argument of
+   lock_init(), is dropped.  A lock initialized again at the same
+   address under the same name, as happens when a thread's page is
+   reused, keeps adding to its earlier record. */
+void
+lockstat_init (struct lock *lock, const char *name)
+{
+  enum intr_level old_level;
+  struct lockstat *s = NULL;
+  size_t i;
+
+  lock->stat = NULL;
+  if (!lockstat_enabled)
+    return;
+  if (*name == '&')
+    name++;
+
+  old_level = intr_disable ();
+  for (i = 0; i < stat_cnt; i++)
+    if (stats[i].lock == lock && !strcmp (stats[i].name, name))
+      {
+        s = &stats[i];
+        break;
+      }
+  if (s == NULL && stat_cnt < LOCKSTAT_CNT)
+    {
+      s = &stats[stat_cnt++];
+      s->lock = lock;
+      strlcpy (s->name, name, sizeof s->name);
+    }
+  else if (s == NULL)
+    dropped_cnt++;
+  lock->stat = s;
+  intr_set_level (old_level);
+}
+
+/* Records that the current thread acquired LOCK, having started
+   to wait for it at cycle count WAIT_START.  CONTENDED says
+   whether LOCK was held by another thread at that point. */
+void
+lockstat_acquired (struct lock *lock, uint64_t wait_start, bool contended)
+{
+  struct lockstat *s = lock->stat;
+  uint64_t now = cpu_cycles ();
+  uint64_t wait = now - wait_start;
+
+  s->acquisitions++;
+  if (contended)
+    {
+      s->contended++;
+      s->wait_total += wait;
+      if (wait > s->wait_max)
+        s->wait_max = wait;
+    }
+  s->acquired_at = now;
+}
+
+/* Records that the current thread is about to release LOCK. */
+void
+lockstat_released (struct lock *lock)
+{
+  struct lockstat *s = lock->stat;
+  uint64_t hold = cpu_cycles () - s->acquired_at;
+
+  s->hold_total += hold;
+  if (hold > s->hold_max)
+    s->hold_max = hold;
+}
+
+/* Records that DONOR, while waiting for LOCK, donated its
+   priority to LOCK's holder.  Only the LOCKSTAT_DONORS most
+   frequent donors are kept: a new donor replaces the least
+   frequent one and inherits its count, so that a donor's count
+   can only be overestimated. */
+void
+lockstat_donated (struct lock *lock, const struct thread *donor)
+{
+  struct lockstat *s = lock->stat;
+  struct lockstat_donor *d, *min = &s->donors[0];
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  s->donations++;
+  for (d = s->donors; d < s->donors + LOCKSTAT_DONORS; d++)
+    {
+      if (d->cnt > 0 && d->tid == donor->tid)
+        break;
+      if (d->cnt < min->cnt)
+        min = d;
+    }
+  if (d == s->donors + LOCKSTAT_DONORS)
+    {
+      d = min;
+      d->tid = donor->tid;
+      strlcpy (d->name, donor->name, sizeof d->name);
+    }
+  d->cnt++;
+  intr_set_level (old_level);
+}
+
+/* Prints the LOCKSTAT_REPORT locks with the most total wait
+   time, if profiling is enabled. */
+void
+lockstat_print_stats (void)
+{
+  bool reported[LOCKSTAT_CNT];
+  int n;
+
+  if (!lockstat_enabled)
+    return;
+
+  printf ("Lockstat: %zu locks profiled", stat_cnt);
+  if (dropped_cnt > 0)
+    printf (", %u not profiled (table full)", dropped_cnt);
+  printf (", top %d by wait time in cycles:\n", LOCKSTAT_REPORT);
+
+  memset (reported, 0, sizeof reported);
+  for (n = 0; n < LOCKSTAT_REPORT; n++)
+    {
+      struct lockstat *s = NULL;
+      size_t i;
+      int j;
+
+      for (i = 0; i < stat_cnt; i++)
+        if (!reported[i] && stats[i].acquisitions > 0
+            && (s == NULL || stats[i].wait_total > s->wait_total))
+          s = &stats[i];
+      if (s == NULL)
+        break;
+      reported[s - stats] = true;
+
+      printf ("Lockstat: %s: %"PRIu64" acquired, %"PRIu64" contended, "
+              "wait %"PRIu64" total %"PRIu64" max, "
+              "hold %"PRIu64" total %"PRIu64" max\n",
+              s->name, s->acquisitions, s->contended,
+              s->wait_total, s->wait_max, s->hold_total, s->hold_max);
+      if (s->donations > 0)
+        {
+          printf ("Lockstat:   %"PRIu64" donations, from", s->donations);
+          for (j = 0; j < LOCKSTAT_DONORS; j++)
+            if (s->donors[j].cnt > 0)
+              printf (" %s(%d):%u", s->donors[j].name, s->donors[j].tid,
+                      s->donors[j].cnt);
+          printf ("\n");
+        }
+    }
+}
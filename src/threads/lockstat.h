@@ -0,0 +1,27 @@
+#ifndef THREADS_LOCKSTAT_H
+#define THREADS_LOCKSTAT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Lock contention profiler.
+
+   When enabled with the "-lockstat" kernel option, every lock
+   initialized afterward gets a record of its acquisitions,
+   contended acquisitions, wait and hold times, and the threads
+   that donated priority to its holders.  The locks with the most
+   total wait time are reported at shutdown.  When disabled, the
+   only cost is a null pointer test on each lock operation. */
+
+struct lock;
+struct thread;
+
+extern bool lockstat_enabled;
+
+void lockstat_init (struct lock *, const char *name);
+void lockstat_acquired (struct lock *, uint64_t wait_start, bool contended);
+void lockstat_released (struct lock *);
+void lockstat_donated (struct lock *, const struct thread *donor);
+void lockstat_print_stats (void);
+
+#endif /* threads/lockstat.h */
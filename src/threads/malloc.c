@@ -5,6 +5,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/allocstat.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
@@ -41,6 +42,8 @@ struct desc
     size_t blocks_per_arena;    /* Number of blocks in an arena. */
     struct list free_list;      /* List of free blocks. */
     struct lock lock;           /* Lock. */
+    size_t arena_cnt;           /* Number of arenas. */
+    size_t in_use;              /* Number of blocks in use. */
   };
 
 /* Magic number for detecting arena corruption. */
@@ -66,12 +69,14 @@ static size_t desc_cnt;         /* Number of descriptors. */
 
 static struct arena *block_to_arena (struct block *);
 static struct block *arena_to_block (struct arena *, size_t idx);
+static void *malloc_from (size_t, const void *caller);
 
 /* Initializes the malloc() descriptors. */
 void
 malloc_init (void) 
 {
   size_t block_size;
+  char name[16];
 
   for (block_size = 16; block_size < PGSIZE / 2; block_size *= 2)
     {
@@ -80,7 +85,9 @@ malloc_init (void)
       d->block_size = block_size;
       d->blocks_per_arena = (PGSIZE - sizeof (struct arena)) / block_size;
       list_init (&d->free_list);
-      lock_init (&d->lock);
+      d->arena_cnt = d->in_use = 0;
+      snprintf (name, sizeof name, "malloc %zu", block_size);
+      lock_init_named (&d->lock, name);
     }
 }
 
@@ -88,6 +95,14 @@ malloc_init (void)
    Returns a null pointer if memory is not available. */
 void *
 malloc (size_t size) 
+{
+  return malloc_from (size, __builtin_return_address (0));
+}
+
+/* Does the work of malloc() for a call made from CALLER, which
+   the allocation profiler charges for the block. */
+static void *
+malloc_from (size_t size, const void *caller)
 {
   struct desc *d;
   struct block *b;
@@ -107,7 +122,7 @@ malloc (size_t size)
       /* SIZE is too big for any descriptor.
          Allocate enough pages to hold SIZE plus an arena. */
       size_t page_cnt = DIV_ROUND_UP (size + sizeof *a, PGSIZE);
-      a = palloc_get_multiple (0, page_cnt);
+      a = palloc_get_backing (0, page_cnt);
       if (a == NULL)
         return NULL;
 
@@ -116,6 +131,9 @@ malloc (size_t size)
       a->magic = ARENA_MAGIC;
       a->desc = NULL;
       a->free_cnt = page_cnt;
+      if (allocstat_enabled)
+        allocstat_alloc (ALLOCSTAT_MALLOC, caller, a + 1, size,
+                         page_cnt * PGSIZE - sizeof *a);
       return a + 1;
     }
 
@@ -127,7 +145,7 @@ malloc (size_t size)
       size_t i;
 
       /* Allocate a page. */
-      a = palloc_get_page (0);
+      a = palloc_get_backing (0, 1);
       if (a == NULL) 
         {
           lock_release (&d->lock);
@@ -138,6 +156,7 @@ malloc (size_t size)
       a->magic = ARENA_MAGIC;
       a->desc = d;
       a->free_cnt = d->blocks_per_arena;
+      d->arena_cnt++;
       for (i = 0; i < d->blocks_per_arena; i++) 
         {
           struct block *b = arena_to_block (a, i);
@@ -149,7 +168,10 @@ malloc (size_t size)
   b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
   a = block_to_arena (b);
   a->free_cnt--;
+  d->in_use++;
   lock_release (&d->lock);
+  if (allocstat_enabled)
+    allocstat_alloc (ALLOCSTAT_MALLOC, caller, b, size, d->block_size);
   return b;
 }
 
@@ -167,7 +189,7 @@ calloc (size_t a, size_t b)
     return NULL;
 
   /* Allocate and zero memory. */
-  p = malloc (size);
+  p = malloc_from (size, __builtin_return_address (0));
   if (p != NULL)
     memset (p, 0, size);
 
@@ -201,7 +223,7 @@ realloc (void *old_block, size_t new_size)
     }
   else 
     {
-      void *new_block = malloc (new_size);
+      void *new_block = malloc_from (new_size, __builtin_return_address (0));
       if (old_block != NULL && new_block != NULL)
         {
           size_t old_size = block_size (old_block);
@@ -223,6 +245,9 @@ free (void *p)
       struct block *b = p;
       struct arena *a = block_to_arena (b);
       struct desc *d = a->desc;
+
+      if (allocstat_enabled)
+        allocstat_free (p);
       
       if (d != NULL) 
         {
@@ -237,6 +262,7 @@ free (void *p)
 
           /* Add block to free list. */
           list_push_front (&d->free_list, &b->free_elem);
+          d->in_use--;
 
           /* If the arena is now entirely unused, free it. */
           if (++a->free_cnt >= d->blocks_per_arena) 
@@ -250,6 +276,7 @@ free (void *p)
                   list_remove (&b->free_elem);
                 }
               palloc_free_page (a);
+              d->arena_cnt--;
             }
 
           lock_release (&d->lock);
@@ -263,6 +290,24 @@ free (void *p)
     }
 }
 
+/* Prints, for each descriptor, how many arenas it has and how
+   many of their blocks are in use. */
+void
+malloc_print_stats (void)
+{
+  struct desc *d;
+
+  for (d = descs; d < descs + desc_cnt; d++)
+    {
+      size_t total = d->arena_cnt * d->blocks_per_arena;
+
+      printf ("Malloc: %zu-byte blocks: %zu arenas, "
+              "%zu of %zu blocks in use (%zu%%)\n",
+              d->block_size, d->arena_cnt, d->in_use, total,
+              total > 0 ? d->in_use * 100 / total : 0);
+    }
+}
+
 /* Returns the arena that block B is inside. */
 static struct arena *
 block_to_arena (struct block *b)
@@ -7,7 +7,10 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/allocstat.h"
+#include "threads/interrupt.h"
 #include "threads/loader.h"
+#include "threads/shrinker.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
 
@@ -23,25 +26,146 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Each pool is managed as a binary buddy system.  A free block
+   of order K is 2**K pages whose page index is a multiple of
+   2**K; its "buddy" is the block of the same order whose index
+   differs from it only in bit K.  Page indexes count from
+   physical address 0, so each block is aligned in physical
+   memory on its own size, as 4 MB large pages require (see
+   pagedir_set_large_page()).  Free blocks are kept on one
+   list per order, linked through a struct list_elem at the
+   start of the block's first page, and `order_map' records the
+   order of each free block at its first page, so that finding
+   out whether a buddy is free to coalesce with takes constant
+   time.  Allocating or freeing a block thus takes O(log n) time.
+
+   Requests for a page count that is not a power of 2 are carved
+   from the next larger block, and the unused tail of the block
+   is freed again right away, so no pages are wasted.  Likewise,
+   any run of allocated pages may be freed, not just whole
+   blocks: the run is freed as a sequence of aligned blocks.
+
+   The pool lock is a spinlock, held with interrupts off, because
+   pages are freed from places where sleeping is not allowed,
+   such as thread_schedule_tail().
+
+   In addition, the idle thread keeps a short list of pages per
+   pool that it has already filled with zeros (see
+   palloc_zero_idle()).  Single-page PAL_ZERO requests take a page
+   from that list when they can, instead of zeroing one on the
+   spot.  Pages on the list count as allocated.
+
+   Finally, a pool that runs out of pages may borrow free memory
+   from the other pool, in chunks of CHUNK_PAGES pages.  Both
+   pools index pages in one space, and `chunk_owner' records
+   which pool each chunk currently belongs to, so a borrowed
+   chunk is simply handed to the borrower's buddy system.  A pool
+   lends only while it keeps its low watermark of free pages, and
+   the kernel pool also keeps a fixed reserve, so user processes
+   cannot starve the kernel.  A borrowed chunk goes back to its
+   home pool as soon as it is entirely free again, provided the
+   borrower stays above its high watermark.
+
+   When even borrowing fails, or a request leaves a pool below
+   its low watermark, the registered shrinkers (see shrinker.h)
+   are asked to give back pages that kernel caches are holding
+   on to, starting with the zeroed lists themselves.  Those
+   caches live in the kernel pool, so a user pool that may not
+   borrow does not ask them.  Nor does a PAL_NORECLAIM request,
+   such as the frame table's, which would rather evict a user
+   page than empty the kernel's caches on every page fault. */
+
+/* Largest block order: blocks of up to 2**10 pages (4 MB). */
+#define BUDDY_MAX_ORDER 10
+#define BUDDY_ORDERS (BUDDY_MAX_ORDER + 1)
+
+/* Pages are lent between pools in chunks of 2**CHUNK_ORDER
+   pages (128 kB).  A chunk covers whole words of `used_map', so
+   that the two pools never modify the same word of it. */
+#define CHUNK_ORDER 5
+#define CHUNK_PAGES (1u << CHUNK_ORDER)
+
+/* Minimum number of free pages that the kernel pool keeps to
+   itself, whatever its low watermark. */
+#define KERNEL_RESERVE_PAGES 64
+
+/* Maximum number of pages kept zeroed in advance per pool.  A
+   pool keeps at most 1/16 of its pages zeroed. */
+#define ZERO_LIST_MAX 64
+
+/* `order_map' value for a page that does not start a free
+   block. */
+#define BUDDY_NOT_FREE 0xff
 
 /* A memory pool. */
 struct pool
   {
-    struct lock lock;                   /* Mutual exclusion. */
-    struct bitmap *used_map;            /* Bitmap of free pages. */
-    uint8_t *base;                      /* Base of pool. */
+    struct spinlock lock;               /* Mutual exclusion. */
+    const char *name;                   /* Name, for statistics. */
+    size_t first;                       /* First page of home range. */
+    size_t home_cnt;                    /* Number of pages in home range. */
+    size_t free_cnt;                    /* Number of free pages. */
+    struct list free_lists[BUDDY_ORDERS]; /* Free blocks, by order. */
+    size_t block_cnt[BUDDY_ORDERS];     /* Lengths of `free_lists'. */
+
+    /* Lending between pools. */
+    bool may_borrow;                    /* May borrow from the other pool? */
+    size_t low;                         /* Free pages never lent away. */
+    size_t high;                        /* Free pages kept when returning. */
+    size_t borrowed_cnt;                /* Pages borrowed now. */
+    size_t lent_cnt;                    /* Pages lent out now. */
+    unsigned long long borrows;         /* # of times pages were borrowed. */
+    unsigned long long returns;         /* # of chunks given back. */
+
+    /* Pages zeroed in advance by the idle thread. */
+    struct list zero_list;              /* Zeroed pages. */
+    size_t zero_cnt;                    /* Length of `zero_list'. */
+    size_t zero_max;                    /* Target length of `zero_list'. */
+    unsigned long long zero_hits;       /* PAL_ZERO requests served from it. */
+    unsigned long long zero_misses;     /* PAL_ZERO requests it was empty for. */
   };
 
 /* Two pools: one for kernel data, one for user pages. */
 static struct pool kernel_pool, user_pool;
 
-static void init_pool (struct pool *, void *base, size_t page_cnt,
-                       const char *name);
-static bool page_from_pool (const struct pool *, void *page);
+/* Page-indexed state shared by both pools.  An entry for a page
+   is only touched with the lock of the pool owning the page's
+   chunk held.  Pages below the first page of the kernel pool
+   belong to no pool. */
+static uint8_t *base;                   /* Address of page 0. */
+static size_t page_total;               /* Number of pages of RAM. */
+static struct bitmap *used_map;         /* Bitmap of free pages. */
+static uint8_t *order_map;              /* Order of free block at each page. */
+static struct pool **chunk_owner;       /* Pool owning each chunk. */
+
+static void init_pool (struct pool *, size_t first, size_t page_cnt,
+                       bool may_borrow, const char *name);
+static struct pool *page_owner (size_t page_idx);
+static struct pool *page_home (size_t page_idx);
+static void *get_pages (struct pool *, size_t page_cnt,
+                        enum palloc_flags, bool *zeroed);
+static size_t buddy_alloc (struct pool *, size_t page_cnt);
+static void buddy_free (struct pool *, size_t page_idx, size_t page_cnt);
+static bool borrow (struct pool *, size_t page_cnt);
+static void give_back (struct pool *, size_t page_idx, size_t page_cnt);
+static void print_pool_stats (const struct pool *);
+static void *take_zeroed (struct pool *);
+static void *get_multiple (enum palloc_flags, size_t page_cnt,
+                           const void *caller);
+static void *get_or_borrow (struct pool *, size_t page_cnt,
+                            enum palloc_flags, bool *zeroed);
+static shrinker_count_func zeroed_count;
+static shrinker_scan_func zeroed_scan;
+
+/* Gives back the pages on the zeroed lists under pressure. */
+static struct shrinker zeroed_shrinker;
 
 /* Initializes the page allocator.  At most USER_PAGE_LIMIT
-   pages are put into the user pool. */
+   pages are put into the user pool, and if USER_PAGE_LIMIT is
+   not SIZE_MAX, the user pool never borrows from the kernel
+   pool either. */
 void
 palloc_init (size_t user_page_limit)
 {
@@ -49,16 +173,43 @@ palloc_init (size_t user_page_limit)
   uint8_t *free_start = ptov (1024 * 1024);
   uint8_t *free_end = ptov (init_ram_pages * PGSIZE);
   size_t free_pages = (free_end - free_start) / PGSIZE;
-  size_t user_pages = free_pages / 2;
-  size_t kernel_pages;
+  size_t chunk_cnt = DIV_ROUND_UP (init_ram_pages, CHUNK_PAGES);
+  size_t bm_size = bitmap_buf_size (init_ram_pages);
+  size_t meta_pages = DIV_ROUND_UP (bm_size + init_ram_pages
+                                    + chunk_cnt * sizeof *chunk_owner,
+                                    PGSIZE);
+  size_t first, boundary, user_pages;
+
+  /* We'll put used_map, chunk_owner and order_map at the start
+     of free memory. */
+  if (meta_pages > free_pages)
+    PANIC ("Not enough memory for page allocator bitmaps.");
+  base = ptov (0);
+  page_total = init_ram_pages;
+  used_map = bitmap_create_in_buf (page_total, free_start, bm_size);
+  chunk_owner = (struct pool **) (free_start + bm_size);
+  memset (chunk_owner, 0, chunk_cnt * sizeof *chunk_owner);
+  order_map = (uint8_t *) (chunk_owner + chunk_cnt);
+  memset (order_map, BUDDY_NOT_FREE, page_total);
+  free_pages -= meta_pages;
+  first = pg_no (free_start) - pg_no (base) + meta_pages;
+
+  /* Give half of memory to kernel, half to user.  The boundary
+     falls on a chunk boundary, so that every chunk has a single
+     home pool. */
+  user_pages = free_pages / 2;
   if (user_pages > user_page_limit)
     user_pages = user_page_limit;
-  kernel_pages = free_pages - user_pages;
+  boundary = ROUND_UP (page_total - user_pages, CHUNK_PAGES);
+  if (boundary > page_total)
+    boundary = page_total;
+
+  init_pool (&kernel_pool, first, boundary - first, true, "kernel pool");
+  init_pool (&user_pool, boundary, page_total - boundary,
+             user_page_limit == SIZE_MAX, "user pool");
 
-  /* Give half of memory to kernel, half to user. */
-  init_pool (&kernel_pool, free_start, kernel_pages, "kernel pool");
-  init_pool (&user_pool, free_start + kernel_pages * PGSIZE,
-             user_pages, "user pool");
+  shrinker_register (&zeroed_shrinker, "zeroed pages",
+                     zeroed_count, zeroed_scan, NULL);
 }
 
 /* Obtains and returns a group of PAGE_CNT contiguous free pages.
@@ -69,29 +220,78 @@ palloc_init (size_t user_page_limit)
    FLAGS, in which case the kernel panics. */
 void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
+{
+  return get_multiple (flags, page_cnt, __builtin_return_address (0));
+}
+
+/* Like palloc_get_multiple(), but for malloc(), whose callers
+   the allocation profiler charges for the blocks it carves from
+   the pages, so that the pages themselves are not charged. */
+void *
+palloc_get_backing (enum palloc_flags flags, size_t page_cnt)
+{
+  return get_multiple (flags, page_cnt, NULL);
+}
+
+/* Does the work of palloc_get_multiple() for a call made from
+   CALLER, which the allocation profiler charges for the pages,
+   unless CALLER is null. */
+static void *
+get_multiple (enum palloc_flags flags, size_t page_cnt, const void *caller)
 {
   struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+  enum intr_level old_level;
   void *pages;
-  size_t page_idx;
+  bool zeroed = false;
 
   if (page_cnt == 0)
     return NULL;
 
-  lock_acquire (&pool->lock);
-  page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-  lock_release (&pool->lock);
+  old_level = intr_disable ();
+  spinlock_acquire (&pool->lock);
+  if (page_cnt == 1 && (flags & PAL_ZERO))
+    {
+      if (pool->zero_cnt > 0)
+        pool->zero_hits++;
+      else
+        pool->zero_misses++;
+    }
+  spinlock_release (&pool->lock);
+  pages = get_or_borrow (pool, page_cnt, flags, &zeroed);
+  intr_set_level (old_level);
 
-  if (page_idx != BITMAP_ERROR)
-    pages = pool->base + PGSIZE * page_idx;
-  else
-    pages = NULL;
+  /* Have kernel caches give pages back, to retry a request that
+     failed or to restore the low watermark of a pool that they
+     can help.  Not in an interrupt handler, though, since that
+     can take a while. */
+  if (!intr_context () && !(flags & PAL_NORECLAIM)
+      && (pool == &kernel_pool || pool->may_borrow))
+    {
+      if (pages == NULL)
+        {
+          if (shrinker_reclaim (page_cnt > pool->low
+                                ? page_cnt : pool->low) > 0)
+            {
+              old_level = intr_disable ();
+              pages = get_or_borrow (pool, page_cnt, flags, &zeroed);
+              intr_set_level (old_level);
+            }
+        }
+      else if (pool->free_cnt < pool->low)
+        shrinker_reclaim (pool->low - pool->free_cnt);
+    }
 
-  if (pages != NULL) 
+  if (pages != NULL)
     {
-      if (flags & PAL_ZERO)
+      if (zeroed)
+        memset (pages, 0, sizeof (struct list_elem));
+      else if (flags & PAL_ZERO)
         memset (pages, 0, PGSIZE * page_cnt);
+      if (allocstat_enabled)
+        allocstat_alloc (ALLOCSTAT_PALLOC, caller, pages,
+                         PGSIZE * page_cnt, PGSIZE * page_cnt);
     }
-  else 
+  else
     {
       if (flags & PAL_ASSERT)
         PANIC ("palloc_get: out of pages");
@@ -108,75 +308,588 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
    available, returns a null pointer, unless PAL_ASSERT is set in
    FLAGS, in which case the kernel panics. */
 void *
-palloc_get_page (enum palloc_flags flags) 
+palloc_get_page (enum palloc_flags flags)
 {
-  return palloc_get_multiple (flags, 1);
+  return get_multiple (flags, 1, __builtin_return_address (0));
 }
 
 /* Frees the PAGE_CNT pages starting at PAGES. */
 void
-palloc_free_multiple (void *pages, size_t page_cnt) 
+palloc_free_multiple (void *pages, size_t page_cnt)
 {
   struct pool *pool;
+  enum intr_level old_level;
   size_t page_idx;
 
   ASSERT (pg_ofs (pages) == 0);
   if (pages == NULL || page_cnt == 0)
     return;
 
-  if (page_from_pool (&kernel_pool, pages))
-    pool = &kernel_pool;
-  else if (page_from_pool (&user_pool, pages))
-    pool = &user_pool;
-  else
-    NOT_REACHED ();
+  ASSERT ((uint8_t *) pages >= base);
+  page_idx = pg_no (pages) - pg_no (base);
+  ASSERT (page_idx + page_cnt <= page_total);
+
+  /* Chunks holding allocated pages never change owner, so this
+     is stable without the lock. */
+  pool = page_owner (page_idx);
+  ASSERT (page_owner (page_idx + page_cnt - 1) == pool);
 
-  page_idx = pg_no (pages) - pg_no (pool->base);
+  if (allocstat_enabled)
+    allocstat_free (pages);
 
 #ifndef NDEBUG
   memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
 
-  ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
-  bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+  old_level = intr_disable ();
+  spinlock_acquire (&pool->lock);
+  ASSERT (bitmap_all (used_map, page_idx, page_cnt));
+  bitmap_set_multiple (used_map, page_idx, page_cnt, false);
+  buddy_free (pool, page_idx, page_cnt);
+  spinlock_release (&pool->lock);
+
+  if (pool->borrowed_cnt > 0)
+    give_back (pool, page_idx, page_cnt);
+  intr_set_level (old_level);
 }
 
 /* Frees the page at PAGE. */
 void
-palloc_free_page (void *page) 
+palloc_free_page (void *page)
 {
   palloc_free_multiple (page, 1);
 }
 
-/* Initializes pool P as starting at START and ending at END,
-   naming it NAME for debugging purposes. */
+/* Zeroes one free page in advance, for a later single-page
+   PAL_ZERO request, in whichever pool's zeroed list is furthest
+   below its target.  Returns true if successful, false if the
+   zeroed lists are full or the pool is down to its low
+   watermark.  Called by
+   the idle thread, so that PAL_ZERO requests usually need not
+   wait for memset(). */
+bool
+palloc_zero_idle (void)
+{
+  struct pool *pool;
+  enum intr_level old_level;
+  size_t page_idx;
+  void *page;
+
+  if (kernel_pool.zero_max - kernel_pool.zero_cnt
+      >= user_pool.zero_max - user_pool.zero_cnt)
+    pool = &kernel_pool;
+  else
+    pool = &user_pool;
+  if (pool->zero_cnt >= pool->zero_max || pool->free_cnt <= pool->low)
+    return false;
+
+  old_level = intr_disable ();
+  spinlock_acquire (&pool->lock);
+  page_idx = buddy_alloc (pool, 1);
+  spinlock_release (&pool->lock);
+  intr_set_level (old_level);
+  if (page_idx == BITMAP_ERROR)
+    return false;
+
+  /* Zero with interrupts on, since this takes a while. */
+  page = base + PGSIZE * page_idx;
+  memset (page, 0, PGSIZE);
+
+  old_level = intr_disable ();
+  spinlock_acquire (&pool->lock);
+  list_push_front (&pool->zero_list, page);
+  pool->zero_cnt++;
+  spinlock_release (&pool->lock);
+  intr_set_level (old_level);
+  return true;
+}
+
+/* Prints the number of free blocks of each order in each
+   pool, and statistics for the pools' zeroed lists and for
+   lending between the pools. */
+void
+palloc_print_stats (void)
+{
+  print_pool_stats (&kernel_pool);
+  print_pool_stats (&user_pool);
+}
+
+/* Initializes pool P as owning the PAGE_CNT pages starting at
+   page FIRST, naming it NAME for debugging purposes.  If
+   MAY_BORROW is true, P may borrow pages from the other pool. */
 static void
-init_pool (struct pool *p, void *base, size_t page_cnt, const char *name) 
+init_pool (struct pool *p, size_t first, size_t page_cnt, bool may_borrow,
+           const char *name)
 {
-  /* We'll put the pool's used_map at its base.
-     Calculate the space needed for the bitmap
-     and subtract it from the pool's size. */
-  size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (page_cnt), PGSIZE);
-  if (bm_pages > page_cnt)
-    PANIC ("Not enough memory in %s for bitmap.", name);
-  page_cnt -= bm_pages;
+  size_t chunk;
+  int order;
 
   printf ("%zu pages available in %s.\n", page_cnt, name);
 
   /* Initialize the pool. */
-  lock_init (&p->lock);
-  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
-  p->base = base + bm_pages * PGSIZE;
+  spinlock_init (&p->lock);
+  p->name = name;
+  p->first = first;
+  p->home_cnt = page_cnt;
+  p->free_cnt = 0;
+  for (order = 0; order < BUDDY_ORDERS; order++)
+    {
+      list_init (&p->free_lists[order]);
+      p->block_cnt[order] = 0;
+    }
+
+  p->may_borrow = may_borrow;
+  p->low = page_cnt / 8;
+  if (p == &kernel_pool && p->low < KERNEL_RESERVE_PAGES)
+    p->low = KERNEL_RESERVE_PAGES;
+  p->high = page_cnt / 4 > p->low ? page_cnt / 4 : p->low;
+  p->borrowed_cnt = p->lent_cnt = 0;
+  p->borrows = p->returns = 0;
+
+  list_init (&p->zero_list);
+  p->zero_cnt = 0;
+  p->zero_max = page_cnt / 16 < ZERO_LIST_MAX ? page_cnt / 16 : ZERO_LIST_MAX;
+  p->zero_hits = p->zero_misses = 0;
+
+  /* Hand all of the pool's pages to its buddy system. */
+  for (chunk = first >> CHUNK_ORDER;
+       chunk < DIV_ROUND_UP (first + page_cnt, CHUNK_PAGES); chunk++)
+    chunk_owner[chunk] = p;
+  buddy_free (p, first, page_cnt);
+}
+
+/* Returns the pool that page PAGE_IDX belongs to now. */
+static struct pool *
+page_owner (size_t page_idx)
+{
+  return chunk_owner[page_idx >> CHUNK_ORDER];
 }
 
-/* Returns true if PAGE was allocated from POOL,
-   false otherwise. */
+/* Returns the pool that page PAGE_IDX was given to initially. */
+static struct pool *
+page_home (size_t page_idx)
+{
+  return page_idx < user_pool.first ? &kernel_pool : &user_pool;
+}
+
+/* Returns the other pool than P. */
+static struct pool *
+other_pool (struct pool *p)
+{
+  return p == &kernel_pool ? &user_pool : &kernel_pool;
+}
+
+/* Acquires the locks of both pools, always in the same order.
+   Interrupts must be off. */
+static void
+lock_pools (void)
+{
+  spinlock_acquire (&kernel_pool.lock);
+  spinlock_acquire (&user_pool.lock);
+}
+
+/* Releases the locks of both pools. */
+static void
+unlock_pools (void)
+{
+  spinlock_release (&user_pool.lock);
+  spinlock_release (&kernel_pool.lock);
+}
+
+/* Returns the address of the block at PAGE_IDX. */
+static inline struct list_elem *
+block_elem (size_t page_idx)
+{
+  return (struct list_elem *) (base + PGSIZE * page_idx);
+}
+
+/* Returns the index of the block whose list element is E. */
+static inline size_t
+block_idx (const struct list_elem *e)
+{
+  return ((const uint8_t *) e - base) / PGSIZE;
+}
+
+/* Puts the block of ORDER at PAGE_IDX on POOL's free lists. */
+static void
+push_block (struct pool *pool, size_t page_idx, int order)
+{
+  list_push_front (&pool->free_lists[order], block_elem (page_idx));
+  order_map[page_idx] = order;
+  pool->block_cnt[order]++;
+}
+
+/* Takes the free block of ORDER at PAGE_IDX off POOL's free
+   lists. */
+static void
+remove_block (struct pool *pool, size_t page_idx, int order)
+{
+  ASSERT (order_map[page_idx] == order);
+  list_remove (block_elem (page_idx));
+  order_map[page_idx] = BUDDY_NOT_FREE;
+  pool->block_cnt[order]--;
+}
+
+/* Returns the smallest order of a block of at least PAGE_CNT
+   pages. */
+static int
+order_for (size_t page_cnt)
+{
+  int order = 0;
+
+  while ((size_t) 1 << order < page_cnt)
+    order++;
+  return order;
+}
+
+/* Takes a block of ORDER off POOL's free lists, splitting a
+   larger block if necessary, and returns its index, or
+   BITMAP_ERROR if there is no free block large enough.  POOL's
+   lock must be held. */
+static size_t
+block_alloc (struct pool *pool, int want)
+{
+  int order;
+  size_t page_idx;
+
+  ASSERT (spinlock_held_by_current_cpu (&pool->lock));
+
+  /* Find the smallest free block that is big enough. */
+  for (order = want; order < BUDDY_ORDERS; order++)
+    if (!list_empty (&pool->free_lists[order]))
+      break;
+  if (order >= BUDDY_ORDERS)
+    return BITMAP_ERROR;
+
+  page_idx = block_idx (list_front (&pool->free_lists[order]));
+  remove_block (pool, page_idx, order);
+
+  /* Split it down to the requested order, freeing the upper
+     halves. */
+  while (order > want)
+    {
+      order--;
+      push_block (pool, page_idx + ((size_t) 1 << order), order);
+    }
+  pool->free_cnt -= (size_t) 1 << order;
+  return page_idx;
+}
+
+/* Takes the block of ORDER at PAGE_IDX off POOL's free lists,
+   splitting the free block that contains it if necessary.
+   Returns false, without changing anything, if the block is not
+   entirely free.  POOL's lock must be held. */
 static bool
-page_from_pool (const struct pool *pool, void *page) 
+block_take (struct pool *pool, size_t page_idx, int want)
+{
+  int order;
+  size_t start;
+
+  ASSERT (spinlock_held_by_current_cpu (&pool->lock));
+
+  /* Find the free block that contains the one we want. */
+  for (order = want; order < BUDDY_ORDERS; order++)
+    {
+      start = page_idx & ~(((size_t) 1 << order) - 1);
+      if (order_map[start] == order && page_owner (start) == pool)
+        break;
+    }
+  if (order >= BUDDY_ORDERS)
+    return false;
+  remove_block (pool, start, order);
+
+  /* Split it, freeing the halves that do not contain it. */
+  while (order > want)
+    {
+      size_t half;
+
+      order--;
+      half = (size_t) 1 << order;
+      if (page_idx & half)
+        {
+          push_block (pool, start, order);
+          start += half;
+        }
+      else
+        push_block (pool, start + half, order);
+    }
+  pool->free_cnt -= (size_t) 1 << order;
+  return true;
+}
+
+/* Allocates PAGE_CNT contiguous pages from POOL and returns the
+   index of the first, or BITMAP_ERROR if there is no free block
+   large enough.  POOL's lock must be held. */
+static size_t
+buddy_alloc (struct pool *pool, size_t page_cnt)
+{
+  int order = order_for (page_cnt);
+  size_t page_idx;
+
+  if (order > BUDDY_MAX_ORDER)
+    return BITMAP_ERROR;
+  page_idx = block_alloc (pool, order);
+  if (page_idx == BITMAP_ERROR)
+    return BITMAP_ERROR;
+
+  /* Give back the pages beyond PAGE_CNT. */
+  if (page_cnt < (size_t) 1 << order)
+    buddy_free (pool, page_idx + page_cnt, ((size_t) 1 << order) - page_cnt);
+
+  ASSERT (!bitmap_any (used_map, page_idx, page_cnt));
+  bitmap_set_multiple (used_map, page_idx, page_cnt, true);
+  return page_idx;
+}
+
+/* Returns the PAGE_CNT pages starting at PAGE_IDX to POOL's
+   buddy system, coalescing them with free buddies.  POOL's lock
+   must be held, or POOL must not be in use yet. */
+static void
+buddy_free (struct pool *pool, size_t page_idx, size_t page_cnt)
+{
+  pool->free_cnt += page_cnt;
+  while (page_cnt > 0)
+    {
+      /* Free the largest aligned block that starts the run. */
+      int order = 0;
+      size_t idx = page_idx;
+
+      while (order < BUDDY_MAX_ORDER
+             && (page_idx & ((size_t) 1 << order)) == 0
+             && (size_t) 2 << order <= page_cnt)
+        order++;
+      page_idx += (size_t) 1 << order;
+      page_cnt -= (size_t) 1 << order;
+
+      /* Coalesce with its buddy for as long as the buddy is
+         free and belongs to the same pool. */
+      while (order < BUDDY_MAX_ORDER)
+        {
+          size_t buddy = idx ^ ((size_t) 1 << order);
+
+          if (buddy + ((size_t) 1 << order) > page_total
+              || order_map[buddy] != order
+              || page_owner (buddy) != pool)
+            break;
+          remove_block (pool, buddy, order);
+          idx &= ~((size_t) 1 << order);
+          order++;
+        }
+      push_block (pool, idx, order);
+    }
+}
+
+/* Makes the block of ORDER at PAGE_IDX, which has already been
+   taken off FROM's free lists, part of TO, and frees it there.
+   Both pools' locks must be held. */
+static void
+move_block (struct pool *from, struct pool *to, size_t page_idx, int order)
+{
+  size_t page_cnt = (size_t) 1 << order;
+  size_t chunk;
+
+  ASSERT (order >= CHUNK_ORDER);
+
+  for (chunk = page_idx >> CHUNK_ORDER;
+       chunk < (page_idx + page_cnt) >> CHUNK_ORDER; chunk++)
+    {
+      chunk_owner[chunk] = to;
+      if (page_home (chunk << CHUNK_ORDER) == to)
+        {
+          /* Going home. */
+          from->borrowed_cnt -= CHUNK_PAGES;
+          to->lent_cnt -= CHUNK_PAGES;
+        }
+      else
+        {
+          from->lent_cnt += CHUNK_PAGES;
+          to->borrowed_cnt += CHUNK_PAGES;
+        }
+    }
+  buddy_free (to, page_idx, page_cnt);
+}
+
+/* Tries to borrow enough pages from the other pool for POOL to
+   satisfy a request for PAGE_CNT pages.  Returns true if
+   successful.  Interrupts must be off. */
+static bool
+borrow (struct pool *pool, size_t page_cnt)
+{
+  struct pool *lender = other_pool (pool);
+  int order = order_for (page_cnt);
+  size_t page_idx = BITMAP_ERROR;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!pool->may_borrow || order > BUDDY_MAX_ORDER)
+    return false;
+  if (order < CHUNK_ORDER)
+    order = CHUNK_ORDER;
+
+  lock_pools ();
+  if (lender->free_cnt >= lender->low + ((size_t) 1 << order))
+    page_idx = block_alloc (lender, order);
+  if (page_idx != BITMAP_ERROR)
+    {
+      move_block (lender, pool, page_idx, order);
+      pool->borrows++;
+    }
+  unlock_pools ();
+
+  return page_idx != BITMAP_ERROR;
+}
+
+/* Gives back to their home pool any chunks, among those holding
+   the PAGE_CNT pages at PAGE_IDX that POOL just freed, that POOL
+   borrowed and that are now entirely free, as long as POOL keeps
+   its high watermark of free pages.  Interrupts must be off. */
+static void
+give_back (struct pool *pool, size_t page_idx, size_t page_cnt)
+{
+  size_t chunk;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  lock_pools ();
+  for (chunk = page_idx >> CHUNK_ORDER;
+       chunk <= (page_idx + page_cnt - 1) >> CHUNK_ORDER; chunk++)
+    {
+      size_t first = chunk << CHUNK_ORDER;
+      struct pool *home = page_home (first);
+
+      if (home == pool || page_owner (first) != pool
+          || pool->free_cnt < pool->high + CHUNK_PAGES
+          || !block_take (pool, first, CHUNK_ORDER))
+        continue;
+      move_block (pool, home, first, CHUNK_ORDER);
+      pool->returns++;
+    }
+  unlock_pools ();
+}
+
+/* Tries to get PAGE_CNT pages from POOL, as described for
+   palloc_get_multiple(), without borrowing.  Sets *ZEROED to
+   true if the pages come from POOL's zeroed list.  Returns the
+   pages, or a null pointer if POOL does not have enough.  POOL's
+   lock must be held. */
+static void *
+get_pages (struct pool *pool, size_t page_cnt, enum palloc_flags flags,
+           bool *zeroed)
+{
+  size_t page_idx;
+
+  if (page_cnt == 1 && (flags & PAL_ZERO) && pool->zero_cnt > 0)
+    {
+      *zeroed = true;
+      return take_zeroed (pool);
+    }
+
+  page_idx = buddy_alloc (pool, page_cnt);
+  if (page_idx != BITMAP_ERROR)
+    return base + PGSIZE * page_idx;
+
+  /* Rather than fail, hand out a page zeroed in advance. */
+  if (page_cnt == 1 && pool->zero_cnt > 0)
+    {
+      *zeroed = true;
+      return take_zeroed (pool);
+    }
+  return NULL;
+}
+
+/* Tries to get PAGE_CNT pages from POOL, borrowing from the
+   other pool if POOL does not have enough.  Sets *ZEROED to true
+   if the pages come from POOL's zeroed list.  Returns the pages,
+   or a null pointer if they are not available.  Interrupts must
+   be off. */
+static void *
+get_or_borrow (struct pool *pool, size_t page_cnt, enum palloc_flags flags,
+               bool *zeroed)
+{
+  void *pages;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  spinlock_acquire (&pool->lock);
+  pages = get_pages (pool, page_cnt, flags, zeroed);
+  spinlock_release (&pool->lock);
+
+  /* Under pressure, borrow from the other pool and try again. */
+  if (pages == NULL && borrow (pool, page_cnt))
+    {
+      spinlock_acquire (&pool->lock);
+      pages = get_pages (pool, page_cnt, flags, zeroed);
+      spinlock_release (&pool->lock);
+    }
+  return pages;
+}
+
+/* Shrinker count function for the zeroed lists. */
+static size_t
+zeroed_count (void *aux UNUSED)
+{
+  return kernel_pool.zero_cnt + user_pool.zero_cnt;
+}
+
+/* Shrinker scan function for the zeroed lists: frees up to
+   PAGE_CNT zeroed pages, kernel pool first, and returns the
+   number freed. */
+static size_t
+zeroed_scan (size_t page_cnt, void *aux UNUSED)
+{
+  size_t cnt = 0;
+
+  while (cnt < page_cnt)
+    {
+      struct pool *pool = kernel_pool.zero_cnt > 0 ? &kernel_pool : &user_pool;
+      enum intr_level old_level;
+      void *page = NULL;
+
+      old_level = intr_disable ();
+      spinlock_acquire (&pool->lock);
+      if (pool->zero_cnt > 0)
+        page = take_zeroed (pool);
+      spinlock_release (&pool->lock);
+      intr_set_level (old_level);
+
+      if (page == NULL)
+        break;
+      palloc_free_page (page);
+      cnt++;
+    }
+  return cnt;
+}
+
+/* Prints POOL's statistics. */
+static void
+print_pool_stats (const struct pool *pool)
+{
+  int order;
+
+  printf ("Palloc: %s: %zu pages free; free blocks by order:",
+          pool->name, pool->free_cnt);
+  for (order = 0; order < BUDDY_ORDERS; order++)
+    printf (" %zu", pool->block_cnt[order]);
+  printf ("\n");
+  printf ("Palloc: %s: %zu pages borrowed, %zu lent; "
+          "%llu borrows, %llu chunks returned\n",
+          pool->name, pool->borrowed_cnt, pool->lent_cnt,
+          pool->borrows, pool->returns);
+  printf ("Palloc: %s: %zu pages zeroed in advance, "
+          "%llu PAL_ZERO hits, %llu misses\n",
+          pool->name, pool->zero_cnt, pool->zero_hits, pool->zero_misses);
+}
+
+/* Removes a page from POOL's zeroed list and returns it.  Its
+   first bytes held the list link, so they must be cleared again
+   before the page is used as a zeroed page.  POOL's lock must be
+   held and the list must not be empty. */
+static void *
+take_zeroed (struct pool *pool)
 {
-  size_t page_no = pg_no (page);
-  size_t start_page = pg_no (pool->base);
-  size_t end_page = start_page + bitmap_size (pool->used_map);
+  ASSERT (spinlock_held_by_current_cpu (&pool->lock));
+  ASSERT (pool->zero_cnt > 0);
 
-  return page_no >= start_page && page_no < end_page;
+  pool->zero_cnt--;
+  return list_pop_front (&pool->zero_list);
 }
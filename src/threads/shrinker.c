@@ -0,0 +1,130 @@
+#include "threads/shrinker.h"
+#include <debug.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+
+/* Shrinkers.
+
+   The page allocator calls shrinker_reclaim() when a request
+   cannot be met, and again after a request that leaves a pool
+   below its low watermark.  Shrinkers are asked in the order
+   they were registered, so cheap sources of pages should
+   register first.
+
+   Only one CPU reclaims at a time.  A CPU that finds reclaim
+   already in progress, or that allocates pages from within a
+   shrinker, does not wait: it gets nothing back and its request
+   fails or proceeds as it would have without shrinkers.
+
+   Shrinkers register as early as thread_init(), before anything
+   can be initialized at run time, so `shrinkers' and
+   `reclaim_lock' rely on static initialization.  A zeroed
+   spinlock is free. */
+
+/* All registered shrinkers. */
+static struct list shrinkers = LIST_INITIALIZER (shrinkers);
+
+/* Held while reclaiming or registering. */
+static struct spinlock reclaim_lock;
+
+/* Statistics. */
+static unsigned long long passes;       /* # of calls that reclaimed. */
+static unsigned long long pages_wanted; /* Pages asked for by them. */
+static unsigned long long pages_reclaimed; /* Pages they got back. */
+
+/* Initializes SHRINKER, which reclaims pages from a cache using
+   COUNT and SCAN, each of them passed AUX, and registers it.
+   NAME identifies the shrinker in statistics. */
+void
+shrinker_register (struct shrinker *shrinker, const char *name,
+                   shrinker_count_func *count, shrinker_scan_func *scan,
+                   void *aux)
+{
+  enum intr_level old_level;
+
+  ASSERT (shrinker != NULL);
+  ASSERT (name != NULL);
+  ASSERT (count != NULL);
+  ASSERT (scan != NULL);
+
+  shrinker->name = name;
+  shrinker->count = count;
+  shrinker->scan = scan;
+  shrinker->aux = aux;
+  shrinker->scans = shrinker->reclaimed = 0;
+
+  old_level = intr_disable ();
+  spinlock_acquire (&reclaim_lock);
+  list_push_back (&shrinkers, &shrinker->elem);
+  spinlock_release (&reclaim_lock);
+  intr_set_level (old_level);
+}
+
+/* Asks the registered shrinkers to give back PAGE_CNT pages to
+   the page allocator, in total, and returns the number of pages
+   they gave back, which may be more or less than PAGE_CNT.
+   Returns 0 immediately if reclaim is already in progress. */
+size_t
+shrinker_reclaim (size_t page_cnt)
+{
+  enum intr_level old_level;
+  struct list_elem *e;
+  size_t cnt = 0;
+
+  old_level = intr_disable ();
+  if (!spinlock_try_acquire (&reclaim_lock))
+    {
+      intr_set_level (old_level);
+      return 0;
+    }
+
+  for (e = list_begin (&shrinkers);
+       e != list_end (&shrinkers) && cnt < page_cnt; e = list_next (e))
+    {
+      struct shrinker *s = list_entry (e, struct shrinker, elem);
+      size_t avail = s->count (s->aux);
+      size_t freed;
+
+      if (avail == 0)
+        continue;
+      freed = s->scan (avail < page_cnt - cnt ? avail : page_cnt - cnt,
+                       s->aux);
+      s->scans++;
+      s->reclaimed += freed;
+      cnt += freed;
+    }
+
+  if (cnt > 0)
+    {
+      passes++;
+      pages_wanted += page_cnt;
+      pages_reclaimed += cnt;
+    }
+  spinlock_release (&reclaim_lock);
+  intr_set_level (old_level);
+
+  return cnt;
+}
+
+/* Prints statistics for every shrinker that has reclaimed
+   pages. */
+void
+shrinker_print_stats (void)
+{
+  struct list_elem *e;
+
+  if (passes == 0)
+    return;
+  printf ("Shrinker: %llu passes reclaimed %llu pages, %llu wanted\n",
+          passes, pages_reclaimed, pages_wanted);
+  for (e = list_begin (&shrinkers); e != list_end (&shrinkers);
+       e = list_next (e))
+    {
+      struct shrinker *s = list_entry (e, struct shrinker, elem);
+
+      if (s->scans > 0)
+        printf ("Shrinker: %s: %llu scans, %llu pages reclaimed\n",
+                s->name, s->scans, s->reclaimed);
+    }
+}
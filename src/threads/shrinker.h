@@ -0,0 +1,44 @@
+#ifndef THREADS_SHRINKER_H
+#define THREADS_SHRINKER_H
+
+#include <list.h>
+#include <stddef.h>
+
+/* Shrinkers.
+
+   A kernel cache that holds on to pages it does not strictly
+   need registers a shrinker, so that the page allocator can ask
+   for those pages back when it runs out, or runs low, instead of
+   failing the request.  See shrinker.c for details. */
+
+/* Returns the number of pages the cache could give back now. */
+typedef size_t shrinker_count_func (void *aux);
+
+/* Gives back up to PAGE_CNT pages to the page allocator and
+   returns the number actually given back.  Must not sleep or
+   allocate pages, and must be safe to call with interrupts
+   off. */
+typedef size_t shrinker_scan_func (size_t page_cnt, void *aux);
+
+/* A shrinker. */
+struct shrinker
+  {
+    const char *name;               /* Name, for statistics. */
+    shrinker_count_func *count;     /* Counts reclaimable pages. */
+    shrinker_scan_func *scan;       /* Reclaims pages. */
+    void *aux;                      /* Passed to `count' and `scan'. */
+
+    /* Statistics. */
+    unsigned long long scans;       /* # of calls to `scan'. */
+    unsigned long long reclaimed;   /* # of pages it gave back. */
+
+    struct list_elem elem;          /* Element in list of shrinkers. */
+  };
+
+void shrinker_register (struct shrinker *, const char *name,
+                        shrinker_count_func *, shrinker_scan_func *,
+                        void *aux);
+size_t shrinker_reclaim (size_t page_cnt);
+void shrinker_print_stats (void);
+
+#endif /* threads/shrinker.h */
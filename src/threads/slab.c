@@ -0,0 +1,353 @@
+#include "threads/slab.h"
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* Object caches.
+
+   Unlike malloc(), which rounds every request up to a power of
+   2, each cache packs objects of exactly its own size (rounded
+   up to a multiple of 4 bytes) into slabs.  A slab is one page,
+   with a struct slab header at its start followed by the
+   objects.  The free objects in a slab are linked through their
+   first word, or, in a cache with a constructor, through an
+   extra word just past the object, so that the constructed
+   state survives while the object is free.
+
+   Each slab is on one of three lists: partial, full or empty.
+   Allocation takes from a partial slab if there is one, then
+   from an empty one, and only then creates a new slab.  A slab
+   that becomes empty is kept on the empty list, up to the
+   cache's retention threshold, so that alternately allocating
+   and freeing a few objects does not keep going back to the page
+   allocator.  kmem_cache_reap() gives all empty slabs back, and
+   each cache registers a shrinker that does the same when the
+   page allocator runs short.
+
+   The lists are protected by a spinlock held with interrupts
+   off, which is enough because the lock is never held across a
+   call to the page allocator. */
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab51ab
+
+/* Slab header, at the start of each slab's page. */
+struct slab
+  {
+    unsigned magic;             /* Always set to SLAB_MAGIC. */
+    struct kmem_cache *cache;   /* Owning cache. */
+    struct list_elem elem;      /* Element in one of cache's lists. */
+    size_t free_cnt;            /* Number of free objects. */
+    void *free;                 /* First free object. */
+  };
+
+/* All caches, for kmem_print_stats(). */
+static struct list caches = LIST_INITIALIZER (caches);
+
+static struct slab *slab_create (struct kmem_cache *);
+static struct slab *obj_to_slab (void *);
+static size_t reap (struct kmem_cache *, size_t max_cnt);
+static shrinker_count_func shrink_count;
+static shrinker_scan_func shrink_scan;
+
+/* Returns the word in OBJ, a free object in CACHE, that links
+   it to the next free object in its slab. */
+static inline void **
+free_link (struct kmem_cache *cache, void *obj)
+{
+  return (void **) ((uint8_t *) obj + (cache->stride - cache->obj_size));
+}
+
+/* Initializes CACHE to hand out objects OBJ_SIZE bytes long,
+   each of them constructed by CTOR (if nonnull) when its slab is
+   created.  NAME identifies the cache in statistics. */
+void
+kmem_cache_init (struct kmem_cache *cache, const char *name,
+                 size_t obj_size, kmem_ctor *ctor)
+{
+  enum intr_level old_level;
+
+  ASSERT (cache != NULL);
+  ASSERT (name != NULL);
+  ASSERT (obj_size > 0);
+
+  strlcpy (cache->name, name, sizeof cache->name);
+  cache->obj_size = ROUND_UP (obj_size < sizeof (void *)
+                              ? sizeof (void *) : obj_size,
+                              sizeof (void *));
+  cache->stride = cache->obj_size + (ctor != NULL ? sizeof (void *) : 0);
+  cache->objs_per_slab = (PGSIZE - sizeof (struct slab)) / cache->stride;
+  ASSERT (cache->objs_per_slab > 0);
+  cache->ctor = ctor;
+  cache->retain = KMEM_RETAIN_DEFAULT;
+
+  spinlock_init (&cache->lock);
+  list_init (&cache->partial);
+  list_init (&cache->full);
+  list_init (&cache->empty);
+  cache->empty_cnt = 0;
+
+  cache->allocs = cache->frees = 0;
+  cache->in_use = cache->slab_cnt = 0;
+  cache->slabs_created = cache->slabs_destroyed = 0;
+
+  old_level = intr_disable ();
+  list_push_back (&caches, &cache->elem);
+  intr_set_level (old_level);
+
+  shrinker_register (&cache->shrinker, cache->name,
+                     shrink_count, shrink_scan, cache);
+}
+
+/* Allocates and returns an object from CACHE, in its constructed
+   state.  Returns a null pointer if memory is not available. */
+void *
+kmem_cache_alloc (struct kmem_cache *cache)
+{
+  enum intr_level old_level;
+  struct slab *new_slab = NULL;
+  struct slab *s;
+  void *obj;
+
+  ASSERT (cache != NULL);
+
+  old_level = intr_disable ();
+  spinlock_acquire (&cache->lock);
+  if (list_empty (&cache->partial) && list_empty (&cache->empty))
+    {
+      /* Drop the lock while getting a page. */
+      spinlock_release (&cache->lock);
+      intr_set_level (old_level);
+
+      new_slab = slab_create (cache);
+      if (new_slab == NULL)
+        return NULL;
+
+      old_level = intr_disable ();
+      spinlock_acquire (&cache->lock);
+      list_push_back (&cache->empty, &new_slab->elem);
+      cache->empty_cnt++;
+      cache->slab_cnt++;
+      cache->slabs_created++;
+    }
+
+  if (!list_empty (&cache->partial))
+    s = list_entry (list_front (&cache->partial), struct slab, elem);
+  else
+    {
+      s = list_entry (list_pop_front (&cache->empty), struct slab, elem);
+      cache->empty_cnt--;
+      list_push_front (&cache->partial, &s->elem);
+    }
+
+  obj = s->free;
+  s->free = *free_link (cache, obj);
+  if (--s->free_cnt == 0)
+    {
+      list_remove (&s->elem);
+      list_push_front (&cache->full, &s->elem);
+    }
+  cache->allocs++;
+  cache->in_use++;
+  spinlock_release (&cache->lock);
+  intr_set_level (old_level);
+
+  return obj;
+}
+
+/* Allocates an object from CACHE, like kmem_cache_alloc(), and
+   fills it with zeros.  Meant for caches without a constructor,
+   whose objects have no constructed state to preserve. */
+void *
+kmem_cache_zalloc (struct kmem_cache *cache)
+{
+  void *obj;
+
+  ASSERT (cache->ctor == NULL);
+
+  obj = kmem_cache_alloc (cache);
+  if (obj != NULL)
+    memset (obj, 0, cache->obj_size);
+  return obj;
+}
+
+/* Returns OBJ, which must have been allocated from CACHE, to
+   CACHE.  If OBJ is a null pointer, does nothing. */
+void
+kmem_cache_free (struct kmem_cache *cache, void *obj)
+{
+  enum intr_level old_level;
+  struct slab *s, *victim = NULL;
+
+  if (obj == NULL)
+    return;
+
+  s = obj_to_slab (obj);
+  ASSERT (s->cache == cache);
+
+#ifndef NDEBUG
+  /* Clear the object to help detect use-after-free bugs, but
+     leave the constructed state alone. */
+  if (cache->ctor == NULL)
+    memset (obj, 0xcc, cache->obj_size);
+#endif
+
+  old_level = intr_disable ();
+  spinlock_acquire (&cache->lock);
+  *free_link (cache, obj) = s->free;
+  s->free = obj;
+  if (s->free_cnt++ == 0)
+    {
+      /* Was full. */
+      list_remove (&s->elem);
+      list_push_front (&cache->partial, &s->elem);
+    }
+  if (s->free_cnt == cache->objs_per_slab)
+    {
+      list_remove (&s->elem);
+      if (cache->empty_cnt < cache->retain)
+        {
+          list_push_front (&cache->empty, &s->elem);
+          cache->empty_cnt++;
+        }
+      else
+        {
+          victim = s;
+          cache->slab_cnt--;
+          cache->slabs_destroyed++;
+        }
+    }
+  cache->frees++;
+  cache->in_use--;
+  spinlock_release (&cache->lock);
+  intr_set_level (old_level);
+
+  if (victim != NULL)
+    {
+      victim->magic = 0;
+      palloc_free_page (victim);
+    }
+}
+
+/* Returns every empty slab in CACHE to the page allocator.
+   Returns the number of pages freed. */
+size_t
+kmem_cache_reap (struct kmem_cache *cache)
+{
+  return reap (cache, SIZE_MAX);
+}
+
+/* Returns up to MAX_CNT empty slabs in CACHE to the page
+   allocator.  Returns the number of pages freed. */
+static size_t
+reap (struct kmem_cache *cache, size_t max_cnt)
+{
+  enum intr_level old_level;
+  struct list victims;
+  size_t cnt = 0;
+
+  list_init (&victims);
+
+  old_level = intr_disable ();
+  spinlock_acquire (&cache->lock);
+  while (!list_empty (&cache->empty) && cnt < max_cnt)
+    {
+      list_push_back (&victims, list_pop_front (&cache->empty));
+      cnt++;
+    }
+  cache->slab_cnt -= cnt;
+  cache->slabs_destroyed += cnt;
+  cache->empty_cnt -= cnt;
+  spinlock_release (&cache->lock);
+  intr_set_level (old_level);
+
+  while (!list_empty (&victims))
+    {
+      struct slab *s = list_entry (list_pop_front (&victims),
+                                   struct slab, elem);
+      s->magic = 0;
+      palloc_free_page (s);
+    }
+  return cnt;
+}
+
+/* Shrinker count function: returns the number of empty slabs
+   in CACHE. */
+static size_t
+shrink_count (void *cache_)
+{
+  struct kmem_cache *cache = cache_;
+  return cache->empty_cnt;
+}
+
+/* Shrinker scan function: reaps up to PAGE_CNT empty slabs from
+   CACHE. */
+static size_t
+shrink_scan (size_t page_cnt, void *cache_)
+{
+  return reap (cache_, page_cnt);
+}
+
+/* Prints statistics for every cache that has been used. */
+void
+kmem_print_stats (void)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&caches); e != list_end (&caches); e = list_next (e))
+    {
+      struct kmem_cache *c = list_entry (e, struct kmem_cache, elem);
+
+      if (c->allocs == 0)
+        continue;
+      printf ("Slab: %s: %zu-byte objects, %zu in use, %zu slabs "
+              "(%zu empty), %llu allocs, %llu frees, "
+              "%llu slabs created, %llu destroyed\n",
+              c->name, c->obj_size, c->in_use, c->slab_cnt, c->empty_cnt,
+              c->allocs, c->frees, c->slabs_created, c->slabs_destroyed);
+    }
+}
+
+/* Gets a page for a new slab for CACHE and sets it up with all
+   of its objects free and constructed.  Returns a null pointer
+   if no page is available. */
+static struct slab *
+slab_create (struct kmem_cache *cache)
+{
+  struct slab *s = palloc_get_page (0);
+  uint8_t *obj;
+  size_t i;
+
+  if (s == NULL)
+    return NULL;
+
+  s->magic = SLAB_MAGIC;
+  s->cache = cache;
+  s->free_cnt = cache->objs_per_slab;
+  s->free = NULL;
+  obj = (uint8_t *) (s + 1) + (cache->objs_per_slab - 1) * cache->stride;
+  for (i = 0; i < cache->objs_per_slab; i++, obj -= cache->stride)
+    {
+      if (cache->ctor != NULL)
+        cache->ctor (obj);
+      *free_link (cache, obj) = s->free;
+      s->free = obj;
+    }
+  return s;
+}
+
+/* Returns the slab that OBJ belongs to. */
+static struct slab *
+obj_to_slab (void *obj)
+{
+  struct slab *s = pg_round_down (obj);
+
+  ASSERT (s->magic == SLAB_MAGIC);
+  ASSERT ((uint8_t *) obj >= (uint8_t *) (s + 1));
+  ASSERT (((uint8_t *) obj - (uint8_t *) (s + 1)) % s->cache->stride == 0);
+  return s;
+}
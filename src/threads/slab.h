@@ -0,0 +1,63 @@
+#ifndef THREADS_SLAB_H
+#define THREADS_SLAB_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "threads/shrinker.h"
+#include "threads/synch.h"
+
+/* Object caches.
+
+   A kmem_cache hands out objects of a single, exact size, carved
+   from page-sized "slabs" obtained from the page allocator.  See
+   slab.c for details. */
+
+/* Constructor, called once on each object when its slab is
+   created.  Objects must be returned to the cache in their
+   constructed state, so that the constructor's work need not be
+   repeated on every allocation. */
+typedef void kmem_ctor (void *obj);
+
+/* Default number of empty slabs a cache keeps around instead of
+   returning them to the page allocator. */
+#define KMEM_RETAIN_DEFAULT 1
+
+/* An object cache. */
+struct kmem_cache
+  {
+    char name[16];              /* Name, for statistics. */
+    size_t obj_size;            /* Size of each object in bytes. */
+    size_t stride;              /* Distance between objects in a slab. */
+    size_t objs_per_slab;       /* Number of objects in a slab. */
+    kmem_ctor *ctor;            /* Constructor, or null. */
+    size_t retain;              /* Max empty slabs to keep. */
+
+    struct spinlock lock;       /* Protects the members below. */
+    struct list partial;        /* Slabs with some objects free. */
+    struct list full;           /* Slabs with no objects free. */
+    struct list empty;          /* Slabs with every object free. */
+    size_t empty_cnt;           /* Number of slabs in `empty'. */
+
+    /* Statistics. */
+    unsigned long long allocs;  /* # of objects allocated. */
+    unsigned long long frees;   /* # of objects freed. */
+    size_t in_use;              /* # of objects allocated now. */
+    size_t slab_cnt;            /* # of slabs now. */
+    unsigned long long slabs_created;   /* # of slabs ever created. */
+    unsigned long long slabs_destroyed; /* # of slabs ever destroyed. */
+
+    struct shrinker shrinker;   /* Reaps empty slabs under pressure. */
+    struct list_elem elem;      /* Element in list of all caches. */
+  };
+
+void kmem_cache_init (struct kmem_cache *, const char *name,
+                      size_t obj_size, kmem_ctor *);
+void *kmem_cache_alloc (struct kmem_cache *);
+void *kmem_cache_zalloc (struct kmem_cache *);
+void kmem_cache_free (struct kmem_cache *, void *);
+size_t kmem_cache_reap (struct kmem_cache *);
+void kmem_print_stats (void);
+
+#endif /* threads/slab.h */
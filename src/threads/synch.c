@@ -29,9 +29,38 @@
 #include "threads/synch.h"
 #include <stdio.h>
 #include <string.h>
+#include "threads/cpu.h"
 #include "threads/interrupt.h"
+#include "threads/lockstat.h"
 #include "threads/thread.h"
 
+/* Wait queues.
+
+   Semaphores and condition variables keep their waiters in a
+   heap ordered by priority, highest first, and by arrival order
+   among waiters of equal priority.  When a waiting thread's
+   priority changes because of donation, sema_change_priority()
+   moves it to its new place. */
+
+/* Arrival order of waiters.  Compared with wraparound, so only
+   the difference between two waiters' numbers matters. */
+static unsigned next_wait_seq;
+
+static heap_less_func sema_waiter_less;
+static heap_less_func cond_waiter_less;
+
+/* Returns true if thread A, which started waiting at arrival
+   number A_SEQ, should be woken before thread B, which started
+   waiting at B_SEQ. */
+static bool
+waits_before (const struct thread *a, unsigned a_seq,
+              const struct thread *b, unsigned b_seq)
+{
+  if (a->priority != b->priority)
+    return a->priority > b->priority;
+  return (int) (a_seq - b_seq) < 0;
+}
+
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
    manipulating it:
@@ -47,7 +76,18 @@ sema_init (struct semaphore *sema, unsigned value)
   ASSERT (sema != NULL);
 
   sema->value = value;
-  list_init (&sema->waiters);
+  heap_init (&sema->waiters, sema_waiter_less, NULL);
+}
+
+/* Orders threads in a semaphore's wait queue. */
+static bool
+sema_waiter_less (const struct heap_elem *a, const struct heap_elem *b,
+                  void *aux UNUSED)
+{
+  const struct thread *ta = heap_entry (a, struct thread, wait_elem);
+  const struct thread *tb = heap_entry (b, struct thread, wait_elem);
+
+  return waits_before (ta, ta->wait_seq, tb, tb->wait_seq);
 }
 
 /* Down or "P" operation on a semaphore.  Waits for SEMA's value
@@ -60,6 +100,7 @@ sema_init (struct semaphore *sema, unsigned value)
 void
 sema_down (struct semaphore *sema) 
 {
+  struct thread *cur = thread_current ();
   enum intr_level old_level;
 
   ASSERT (sema != NULL);
@@ -68,8 +109,9 @@ sema_down (struct semaphore *sema)
   old_level = intr_disable ();
   while (sema->value == 0) 
     {
-      //list_push_back (&sema->waiters, &thread_current ()->elem);
-      list_insert_ordered(&sema->waiters, &thread_current ()->elem, thread_compare_priority, 0);
+      cur->wait_sema = sema;
+      cur->wait_seq = next_wait_seq++;
+      heap_insert (&sema->waiters, &cur->wait_elem);
       thread_block ();
     }
   sema->value--;
@@ -104,12 +146,15 @@ sema_try_down (struct semaphore *sema)
 
 /* Up or "V" operation on a semaphore.  Increments SEMA's value
    and wakes up one thread of those waiting for SEMA, if any.
+   The running thread gives up the CPU only if the thread woken
+   up has a higher priority.
 
    This function may be called from an interrupt handler. */
 void
 sema_up (struct semaphore *sema) 
 {
   enum intr_level old_level;
+  struct thread *t = NULL;
 
   ASSERT (sema != NULL);
 
@@ -117,22 +162,42 @@ sema_up (struct semaphore *sema)
 
   sema->value++;
 
-  if (!list_empty (&sema->waiters)) {
-    list_sort(&sema->waiters, thread_compare_priority, 0);
-    thread_unblock (list_entry (list_pop_front (&sema->waiters), struct thread, elem));
+  if (!heap_empty (&sema->waiters)) {
+    t = heap_entry (heap_pop_min (&sema->waiters), struct thread, wait_elem);
+    t->wait_sema = NULL;
+    thread_unblock (t);
   }
 
-  // if (next != NULL && next -> priority > thread_current()->priority) {
-  //   thread_yield();
-  // }
-
-  if(!intr_context())
-    thread_yield();
+  if (t != NULL && t->priority > thread_current ()->priority) {
+    if (intr_context ())
+      intr_yield_on_return ();
+    else
+      thread_yield ();
+  }
   
   intr_set_level (old_level);
+}
 
-  //thread_test_preemption ();
-  //thread_yield();
+/* Sets the priority of T, which is blocked on a semaphore or in
+   a condition variable's wait queue, to PRIORITY, and moves T to
+   its new place in the wait queue.  Interrupts must be off. */
+void
+sema_change_priority (struct thread *t, int priority)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (t->wait_sema != NULL || t->wait_cond != NULL);
+
+  if (t->wait_sema != NULL)
+    heap_remove (&t->wait_sema->waiters, &t->wait_elem);
+  if (t->wait_cond != NULL)
+    heap_remove (&t->wait_cond->waiters, t->wait_cond_elem);
+
+  t->priority = priority;
+
+  if (t->wait_sema != NULL)
+    heap_insert (&t->wait_sema->waiters, &t->wait_elem);
+  if (t->wait_cond != NULL)
+    heap_insert (&t->wait_cond->waiters, t->wait_cond_elem);
 }
 
 static void sema_test_helper (void *sema_);
@@ -186,14 +251,18 @@ sema_test_helper (void *sema_)
    another one "up" it, but with a lock the same thread must both
    acquire and release it.  When these restrictions prove
    onerous, it's a good sign that a semaphore should be used,
-   instead of a lock. */
+   instead of a lock.
+
+   NAME identifies the lock in the lock profiler's report. */
 void
-lock_init (struct lock *lock)
+lock_init_named (struct lock *lock, const char *name)
 {
   ASSERT (lock != NULL);
+  ASSERT (name != NULL);
 
   lock->holder = NULL;
   sema_init (&lock->semaphore, 1);
+  lockstat_init (lock, name);
 }
 
 /* Acquires LOCK, sleeping until it becomes available if
@@ -212,10 +281,14 @@ lock_acquire (struct lock *lock)
   ASSERT (!lock_held_by_current_thread (lock));
 
   struct thread *cur = thread_current();
+  uint64_t wait_start = lock->stat != NULL ? cpu_cycles () : 0;
+  bool contended = lock->semaphore.value == 0;
 
   if (thread_mlfqs) {
     sema_down (&lock->semaphore);
     lock->holder = cur;
+    if (lock->stat != NULL)
+      lockstat_acquired (lock, wait_start, contended);
     return ;
   }
 
@@ -227,12 +300,16 @@ lock_acquire (struct lock *lock)
     /* maintain donated threads on donations list of lock holder */
     list_insert_ordered(&lock->holder->donations, &cur->donation_elem, thread_compare_donate_priority, NULL);
 
+    if (lock->stat != NULL && lock->holder->priority < cur->priority)
+      lockstat_donated (lock, cur);
     donate_priority();
   }
 
   sema_down (&lock->semaphore);
   cur->wait_on_lock = NULL;
   lock->holder = cur;
+  if (lock->stat != NULL)
+    lockstat_acquired (lock, wait_start, contended);
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -251,7 +328,11 @@ lock_try_acquire (struct lock *lock)
 
   success = sema_try_down (&lock->semaphore);
   if (success)
-    lock->holder = thread_current ();
+    {
+      lock->holder = thread_current ();
+      if (lock->stat != NULL)
+        lockstat_acquired (lock, cpu_cycles (), false);
+    }
   return success;
 }
 
@@ -266,6 +347,8 @@ lock_release (struct lock *lock)
   ASSERT (lock != NULL);
   ASSERT (lock_held_by_current_thread (lock));
 
+  if (lock->stat != NULL)
+    lockstat_released (lock);
   lock->holder = NULL;
 
   if (thread_mlfqs) {
@@ -294,13 +377,27 @@ lock_held_by_current_thread (const struct lock *lock)
   return lock->holder == thread_current ();
 }
 
-/* One semaphore in a list. */
+/* One semaphore in a condition variable's wait queue. */
 struct semaphore_elem 
   {
-    struct list_elem elem;              /* List element. */
+    struct heap_elem elem;              /* Heap element. */
     struct semaphore semaphore;         /* This semaphore. */
+    struct thread *thread;              /* Thread waiting on it. */
+    unsigned seq;                       /* Arrival order. */
   };
 
+/* Orders semaphores in a condition variable's wait queue by the
+   threads waiting on them. */
+static bool
+cond_waiter_less (const struct heap_elem *a, const struct heap_elem *b,
+                  void *aux UNUSED)
+{
+  const struct semaphore_elem *sa = heap_entry (a, struct semaphore_elem, elem);
+  const struct semaphore_elem *sb = heap_entry (b, struct semaphore_elem, elem);
+
+  return waits_before (sa->thread, sa->seq, sb->thread, sb->seq);
+}
+
 /* Initializes condition variable COND.  A condition variable
    allows one piece of code to signal a condition and cooperating
    code to receive the signal and act upon it. */
@@ -309,7 +406,7 @@ cond_init (struct condition *cond)
 {
   ASSERT (cond != NULL);
 
-  list_init (&cond->waiters);
+  heap_init (&cond->waiters, cond_waiter_less, NULL);
 }
 
 /* Atomically releases LOCK and waits for COND to be signaled by
@@ -335,7 +432,9 @@ cond_init (struct condition *cond)
 void
 cond_wait (struct condition *cond, struct lock *lock) 
 {
+  struct thread *cur = thread_current ();
   struct semaphore_elem waiter;
+  enum intr_level old_level;
 
   ASSERT (cond != NULL);
   ASSERT (lock != NULL);
@@ -343,8 +442,15 @@ cond_wait (struct condition *cond, struct lock *lock)
   ASSERT (lock_held_by_current_thread (lock));
   
   sema_init (&waiter.semaphore, 0);
-  //list_push_back (&cond->waiters, &waiter.elem);
-  list_insert_ordered (&cond->waiters, &waiter.elem, sema_compare_priority, 0);
+  waiter.thread = cur;
+
+  old_level = intr_disable ();
+  cur->wait_cond = cond;
+  cur->wait_cond_elem = &waiter.elem;
+  waiter.seq = next_wait_seq++;
+  heap_insert (&cond->waiters, &waiter.elem);
+  intr_set_level (old_level);
+
   lock_release (lock);
   sema_down (&waiter.semaphore);
   lock_acquire (lock);
@@ -365,12 +471,17 @@ cond_signal (struct condition *cond, struct lock *lock UNUSED)
   ASSERT (!intr_context ());
   ASSERT (lock_held_by_current_thread (lock));
 
-  if (!list_empty (&cond->waiters)) {
-    list_sort(&cond->waiters, sema_compare_priority, 0);
-    sema_up (&list_entry (list_pop_front (&cond->waiters),
-                          struct semaphore_elem, elem)->semaphore);
+  if (!heap_empty (&cond->waiters)) {
+    enum intr_level old_level = intr_disable ();
+    struct semaphore_elem *waiter
+      = heap_entry (heap_pop_min (&cond->waiters), struct semaphore_elem, elem);
+
+    waiter->thread->wait_cond = NULL;
+    waiter->thread->wait_cond_elem = NULL;
+    intr_set_level (old_level);
+
+    sema_up (&waiter->semaphore);
   }
-    
 }
 
 /* Wakes up all threads, if any, waiting on COND (protected by
@@ -385,17 +496,201 @@ cond_broadcast (struct condition *cond, struct lock *lock)
   ASSERT (cond != NULL);
   ASSERT (lock != NULL);
 
-  while (!list_empty (&cond->waiters))
+  while (!heap_empty (&cond->waiters))
     cond_signal (cond, lock);
 }
 
+/* Initializes readers-writer lock RW as held by nobody. */
+void
+rwlock_init (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  lock_init (&rw->gate);
+  rw->readers = 0;
+  rw->writer = NULL;
+  sema_init (&rw->drained, 0);
+}
+
+/* Acquires RW for reading, sleeping until no writer holds it or
+   is waiting for it.  The current thread may hold at most
+   RWLOCK_READ_MAX locks for reading at a time, and must not
+   already hold RW.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_acquire_read (struct rwlock *rw)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  int i;
+
+  ASSERT (rw != NULL);
+  ASSERT (!intr_context ());
+
+  /* Queue up behind any writer, donating to it. */
+  lock_acquire (&rw->gate);
+
+  old_level = intr_disable ();
+  for (i = 0; cur->read_locks[i] != NULL; i++)
+    {
+      ASSERT (i + 1 < RWLOCK_READ_MAX);
+      ASSERT (cur->read_locks[i] != rw);
+    }
+  cur->read_locks[i] = rw;
+  rw->readers++;
+  intr_set_level (old_level);
+
+  lock_release (&rw->gate);
+}
+
+/* Releases RW, which the current thread must hold for reading.
+   The last reader to leave wakes up a waiting writer. */
+void
+rwlock_release_read (struct rwlock *rw)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  int i;
+
+  ASSERT (rw != NULL);
+
+  old_level = intr_disable ();
+  for (i = 0; cur->read_locks[i] != rw; i++)
+    ASSERT (i + 1 < RWLOCK_READ_MAX);
+  for (; i + 1 < RWLOCK_READ_MAX; i++)
+    cur->read_locks[i] = cur->read_locks[i + 1];
+  cur->read_locks[RWLOCK_READ_MAX - 1] = NULL;
+  ASSERT (rw->readers > 0);
+  rw->readers--;
+
+  /* Give up any priority the writer donated before letting it
+     run. */
+  if (!thread_mlfqs)
+    refresh_priority ();
+  if (rw->readers == 0 && rw->writer != NULL)
+    sema_up (&rw->drained);
+  intr_set_level (old_level);
+}
+
+/* Acquires RW for writing, sleeping until every reader has left.
+   New readers are held off from the moment this is called.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_acquire_write (struct rwlock *rw)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (rw != NULL);
+  ASSERT (!intr_context ());
+
+  lock_acquire (&rw->gate);
+
+  old_level = intr_disable ();
+  while (rw->readers > 0)
+    {
+      rw->writer = cur;
+      cur->wait_on_rwlock = rw;
+      if (!thread_mlfqs)
+        donate_priority_to_readers (rw, cur->priority);
+      sema_down (&rw->drained);
+      cur->wait_on_rwlock = NULL;
+      rw->writer = NULL;
+    }
+  intr_set_level (old_level);
+}
+
+/* Releases RW, which the current thread must hold for writing. */
+void
+rwlock_release_write (struct rwlock *rw)
+{
+  ASSERT (rwlock_held_for_write (rw));
+
+  lock_release (&rw->gate);
+}
+
+/* Returns true if the current thread holds RW for writing, false
+   otherwise. */
+bool
+rwlock_held_for_write (const struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  return lock_held_by_current_thread (&rw->gate) && rw->readers == 0;
+}
+
+/* Initializes spinlock LOCK as released. */
+void
+spinlock_init (struct spinlock *lock)
+{
+  ASSERT (lock != NULL);
+
+  lock->locked = 0;
+}
+
+/* Atomically sets LOCK's `locked' member to 1 and returns its
+   old value.  See [IA32-v2b] "XCHG", which is implicitly locked
+   when one operand is in memory. */
+static inline uint32_t
+spinlock_xchg (struct spinlock *lock)
+{
+  uint32_t old = 1;
+  asm volatile ("xchgl %0, %1" : "+r" (old), "+m" (lock->locked)
+                : : "memory");
+  return old;
+}
+
+/* Acquires LOCK, spinning until it becomes available.
+   Interrupts must be off, and LOCK must not already be held by
+   the current CPU. */
+void
+spinlock_acquire (struct spinlock *lock)
+{
+  ASSERT (lock != NULL);
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (!spinlock_held_by_current_cpu (lock));
+
+  while (spinlock_xchg (lock) != 0)
+    while (lock->locked)
+      asm volatile ("pause");
+}
+
+/* Tries to acquire LOCK without spinning.  Returns true if
+   successful, false if LOCK is held by someone else.  Interrupts
+   must be off. */
 bool
-sema_compare_priority (const struct list_elem *l, const struct list_elem *s, void *aux UNUSED) {
-  struct semaphore_elem *l_sema = list_entry(l, struct semaphore_elem, elem);
-  struct semaphore_elem *s_sema = list_entry(s, struct semaphore_elem, elem);
+spinlock_try_acquire (struct spinlock *lock)
+{
+  ASSERT (lock != NULL);
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  return spinlock_xchg (lock) == 0;
+}
 
-  struct list *waiter_l_sema = &(l_sema -> semaphore.waiters);
-  struct list *waiter_s_sema = &(s_sema -> semaphore.waiters);
+/* Releases LOCK, which must be held by the current CPU.
+   Interrupts must still be off. */
+void
+spinlock_release (struct spinlock *lock)
+{
+  ASSERT (lock != NULL);
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (spinlock_held_by_current_cpu (lock));
 
-  return  list_entry(list_begin (waiter_l_sema), struct thread, elem)->priority > list_entry(list_begin (waiter_s_sema), struct thread, elem)->priority;
-}
\ No newline at end of file
+  barrier ();
+  lock->locked = 0;
+}
+
+/* Returns true if the current CPU holds LOCK, false
+   otherwise.  There is only one CPU, so that is whether LOCK is
+   held at all. */
+bool
+spinlock_held_by_current_cpu (const struct spinlock *lock)
+{
+  ASSERT (lock != NULL);
+
+  return lock->locked;
+}
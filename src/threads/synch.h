@@ -1,14 +1,18 @@
 #ifndef THREADS_SYNCH_H
 #define THREADS_SYNCH_H
 
+#include <heap.h>
 #include <list.h>
 #include <stdbool.h>
+#include <stdint.h>
+
+struct thread;
 
 /* A counting semaphore. */
 struct semaphore 
   {
     unsigned value;             /* Current value. */
-    struct list waiters;        /* List of waiting threads. */
+    struct heap waiters;        /* Waiting threads, highest priority first. */
   };
 
 void sema_init (struct semaphore *, unsigned value);
@@ -16,15 +20,21 @@ void sema_down (struct semaphore *);
 bool sema_try_down (struct semaphore *);
 void sema_up (struct semaphore *);
 void sema_self_test (void);
+void sema_change_priority (struct thread *, int priority);
 
 /* Lock. */
 struct lock 
   {
     struct thread *holder;      /* Thread holding lock (for debugging). */
     struct semaphore semaphore; /* Binary semaphore controlling access. */
+    struct lockstat *stat;      /* Contention statistics, or null. */
   };
 
-void lock_init (struct lock *);
+/* lock_init() names the lock after the expression used to refer
+   to it, for the lock profiler (see threads/lockstat.h).  Use
+   lock_init_named() to give a better name. */
+#define lock_init(LOCK) lock_init_named (LOCK, #LOCK)
+void lock_init_named (struct lock *, const char *name);
 void lock_acquire (struct lock *);
 bool lock_try_acquire (struct lock *);
 void lock_release (struct lock *);
@@ -33,7 +43,7 @@ bool lock_held_by_current_thread (const struct lock *);
 /* Condition variable. */
 struct condition 
   {
-    struct list waiters;        /* List of waiting threads. */
+    struct heap waiters;        /* Waiting threads, highest priority first. */
   };
 
 void cond_init (struct condition *);
@@ -41,7 +51,54 @@ void cond_wait (struct condition *, struct lock *);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
-bool sema_compare_priority (const struct list_elem *l, const struct list_elem *s, void *aux);
+/* Readers-writer lock.
+
+   Any number of readers may hold it at once, or a single writer.
+   Writers are preferred: once a writer is waiting, readers that
+   arrive after it wait until it is done, so a steady stream of
+   readers cannot starve writers.
+
+   A writer holds `gate' from the time it arrives until it
+   releases the lock, so readers and writers queued behind it
+   donate their priority to it through the ordinary lock
+   machinery.  A writer waiting for the readers to leave in turn
+   donates its priority to each of them. */
+struct rwlock
+  {
+    struct lock gate;           /* Held by the writer, or briefly by a reader. */
+    unsigned readers;           /* # of threads holding it for reading. */
+    struct thread *writer;      /* Writer waiting for readers to leave. */
+    struct semaphore drained;   /* Upped when the last reader leaves. */
+  };
+
+/* Maximum number of readers-writer locks one thread may hold
+   for reading at the same time. */
+#define RWLOCK_READ_MAX 4
+
+void rwlock_init (struct rwlock *);
+void rwlock_acquire_read (struct rwlock *);
+void rwlock_release_read (struct rwlock *);
+void rwlock_acquire_write (struct rwlock *);
+void rwlock_release_write (struct rwlock *);
+bool rwlock_held_for_write (const struct rwlock *);
+
+/* Spinlock.  Protects data for short critical sections that
+   may not sleep.  Must be acquired and released with interrupts
+   off.  On the single CPU that this kernel runs, turning
+   interrupts off already keeps every other thread out, so a
+   spinlock is never contended; it marks the data that would
+   need it on more than one CPU and lets assertions check that
+   the critical section is held. */
+struct spinlock
+  {
+    volatile uint32_t locked;   /* 1 while held, 0 otherwise. */
+  };
+
+void spinlock_init (struct spinlock *);
+void spinlock_acquire (struct spinlock *);
+bool spinlock_try_acquire (struct spinlock *);
+void spinlock_release (struct spinlock *);
+bool spinlock_held_by_current_cpu (const struct spinlock *);
 
 /* Optimization barrier.
 
@@ -1,13 +1,16 @@
 #include "threads/thread.h"
 #include <debug.h>
 #include <stddef.h>
+#include <inttypes.h>
 #include <random.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/cpu.h"
 #include "threads/flags.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
 #include "threads/palloc.h"
+#include "threads/shrinker.h"
 #include "threads/switch.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
@@ -21,23 +24,50 @@
    of thread.h for details. */
 #define THREAD_MAGIC 0xcd6abf4b
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
+/* ready_bitmap has one bit per priority level. */
+#if PRI_MIN != 0 || PRI_CNT > 64
+#error run queue bitmap requires priorities in 0...63
+#endif
+
+/* Run queue of processes in THREAD_READY state, that is,
+   processes that are ready to run but not actually running.
+   There is one FIFO list per priority level, and bit P of
+   ready_bitmap is set exactly when ready_queues[P] is nonempty,
+   so that enqueueing, dequeueing and finding the highest
+   priority ready thread all take constant time. */
+static struct list ready_queues[PRI_CNT];
+static uint64_t ready_bitmap;
+static size_t ready_cnt;        /* # of threads in the run queue. */
 
 /* List of all processes.  Processes are added to this list
    when they are first scheduled and removed when they exit. */
 static struct list all_list;
 
-/* List of processes in sleep */
-static struct list sleep_list;
-
 /* Idle thread. */
 static struct thread *idle_thread;
 
 /* Initial thread, the thread running init.c:main(). */
 static struct thread *initial_thread;
 
+/* Cache of pages left behind by threads that have exited.
+   thread_create() takes a page from here when it can, instead of
+   scanning the page allocator's bitmap and zeroing a new page.
+   Only `struct thread' itself needs to be initialized again; the
+   rest of the page is stack, which needs no particular contents.
+   Each cached page is linked into the cache through its old
+   struct thread's `elem'.  Its shrinker frees cached pages when
+   memory runs short. */
+size_t thread_cache_size = THREAD_CACHE_DEFAULT;
+static struct list thread_cache;
+static size_t thread_cache_cnt;         /* # of pages in thread_cache. */
+static struct spinlock thread_cache_lock;
+static long long thread_cache_hits;     /* # of pages taken from cache. */
+static long long thread_cache_misses;   /* # of pages from palloc. */
+static long long thread_cache_overflows; /* # of pages freed, cache full. */
+static struct shrinker thread_cache_shrinker;
+static shrinker_count_func thread_cache_count;
+static shrinker_scan_func thread_cache_scan;
+
 /* Lock used by allocate_tid(). */
 static struct lock tid_lock;
 
@@ -54,13 +84,40 @@ static long long idle_ticks;    /* # of timer ticks spent idle. */
 static long long kernel_ticks;  /* # of timer ticks in kernel threads. */
 static long long user_ticks;    /* # of timer ticks in user programs. */
 
-/* global tick */
-static long long global_tick;
+/* Run queue length, sampled every timer tick.  rq_history[] holds 100 times the average length
+   over each of the last SCHED_RQ_HISTORY seconds, indexed by
+   second modulo SCHED_RQ_HISTORY. */
+static uint64_t rq_samples;     /* # of samples. */
+static uint64_t rq_len_total;   /* Sum of all samples. */
+static uint32_t rq_len_max;     /* Largest sample. */
+static uint64_t rq_len_second;  /* Sum of samples this second. */
+static uint32_t rq_history[SCHED_RQ_HISTORY];
+static int64_t rq_seconds;      /* # of seconds in rq_history so far. */
+
+/* Scheduler statistics for all threads. */
+static struct sched_counters sched_all; /* Switches and wakeups. */
+static uint64_t schedule_start; /* Cycle count at entry to schedule(). */
+static uint64_t schedule_cnt;   /* # of schedule() calls. */
+static uint64_t schedule_cycles; /* Cycles spent in schedule(). */
+static uint64_t schedule_cycles_max; /* Longest schedule() call. */
 
 bool threading_started = false;
 
 int load_avg;
 
+/* MLFQS recent_cpu decay history.  Every second, load_avg is
+   updated and the decay coefficient 2*load_avg/(2*load_avg + 1)
+   for that second is recorded in decay_history.  Only running
+   and ready threads are decayed on time; a blocked thread
+   replays the coefficients it missed when it wakes up, so the
+   timer interrupt never has to visit blocked threads.  A thread
+   blocked for longer than DECAY_HISTORY seconds only replays the
+   most recent DECAY_HISTORY of them, by which point its
+   recent_cpu has long converged. */
+#define DECAY_HISTORY 64        /* Must be a power of 2. */
+static int decay_history[DECAY_HISTORY];
+static int64_t mlfqs_seconds;   /* # of load_avg updates so far. */
+
 /* Scheduling. */
 #define TIME_SLICE 4            /* # of timer ticks to give each thread. */
 static unsigned thread_ticks;   /* # of timer ticks since last yield. */
@@ -82,6 +139,19 @@ static void *alloc_frame (struct thread *, size_t size);
 static void schedule (void);
 void thread_schedule_tail (struct thread *prev);
 static tid_t allocate_tid (void);
+static struct thread *alloc_thread_page (void);
+static void free_thread_page (struct thread *);
+static timer_func thread_wake_up;
+static int mlfqs_priority (struct thread *);
+static void donate_chain (struct thread *, int priority);
+static void ready_queue_push (struct thread *);
+static void ready_queue_remove (struct thread *);
+static struct thread *ready_queue_pop (void);
+static int ready_queue_max_priority (void);
+static void sample_run_queues (void);
+static void record_wakeup (struct sched_counters *, uint64_t latency);
+static void print_counters (const char *, const struct sched_counters *);
+static void thread_change_priority (struct thread *, int priority);
 
 /* Initializes the threading system by transforming the code
    that's currently running into a thread.  This can't work in
@@ -99,18 +169,20 @@ static tid_t allocate_tid (void);
 void
 thread_init (void) 
 {
+  int pri;
 
   ASSERT (intr_get_level () == INTR_OFF);
 
   lock_init (&tid_lock);
-  list_init (&ready_list);
+  for (pri = PRI_MIN; pri <= PRI_MAX; pri++)
+    list_init (&ready_queues[pri]);
+  ready_bitmap = 0;
+  ready_cnt = 0;
   list_init (&all_list);
-
-  /* initialize for sleep_list */
-  list_init (&sleep_list);
-
-  /* global tick */
-  global_tick = INT64_MAX;
+  list_init (&thread_cache);
+  spinlock_init (&thread_cache_lock);
+  shrinker_register (&thread_cache_shrinker, "thread pages",
+                     thread_cache_count, thread_cache_scan, NULL);
 
   /* Set up a thread structure for the running thread. */
   initial_thread = running_thread ();
@@ -155,20 +227,22 @@ thread_tick (void)
 #endif
   else
     kernel_ticks++;
+  sample_run_queues ();
 
   if (thread_mlfqs) {
     // increase recent_cpu by 1 every 1 tick
     increase_recent_cpu();
 
-    // recalculate load_avg, recent_cpu of all threads, priority every 1 sec
-    if (timer_ticks() % 100 == 0) {
+    // recalculate load_avg, recent_cpu of running and ready threads every 1 sec
+    if (timer_ticks() % TIMER_FREQ == 0) {
       calculate_load_avg();
-      recalculate_all_recent_cpu();
+      recalculate_ready_threads();
     }
 
-    // recalculate priority of all threads every 4th tick
+    // only the running thread's recent_cpu changed since the last update,
+    // so it is the only priority to recalculate every 4th tick
     if (timer_ticks() % 4 == 0) {
-      recalculate_all_priority();
+      calculate_priority(t);
     }
   }
 
@@ -194,64 +268,30 @@ thread_sleep(int64_t ticks) {
   // store the local tick to wake up
   cur->local_tick = ticks;
 
-  // update the global tick if necessary
-  if (global_tick > ticks) {
-    global_tick = ticks;
-  }
+  // the timer interrupt runs thread_wake_up() at that tick
+  timer_event_schedule (&cur->sleep_event, ticks);
 
   // change the state of the caller thread to BLOCKED (sleep)
-  list_push_back (&sleep_list, &cur->elem);
-
   thread_block();
 }
 
-void
-thread_wake_up(int64_t ticks) {
-  // get first element of sleep_list
-  struct list_elem *e = list_begin(&sleep_list);
-
-  // check all thread
-  while (e != list_end(&sleep_list)) {
-    struct thread *t = list_entry(e, struct thread, elem);
-
-    // if that thread is needed to wake up
-    if (t->local_tick <=  ticks) {
-      // remove from sleep_list and return next thread
-      e = list_remove (e);
-
-      // change thread status to ready
-      thread_unblock(t);
-    }
-    else {
-      e = list_next(e);
-    }
-  } 
-  
-}
-
 /*
- * get global tick 
+ * timer event function: wake up sleeping thread T_
  */
-int64_t 
-get_global_tick(void) {
-  return global_tick;
-}
+static void
+thread_wake_up (void *t_) {
+  struct thread *t = t_;
 
-/*
- * find location of list for insert with priority 
- */
-bool
-thread_compare_priority(struct list_elem *l, struct list_elem *s, void *aux UNUSED) {
-  return list_entry (l, struct thread, elem)->priority > list_entry(s, struct thread, elem)->priority;
+  thread_unblock (t);
 }
 
 /**
- * compare priority of running thread and newly thread (front of ready_list)
+ * yield if some ready thread has higher priority than the running thread
  */
 void
 thread_test_preemption (void){
-  if (!list_empty(&ready_list) && thread_current()->priority < list_entry(list_front(&ready_list), struct thread, elem)->priority)
-    thread_yield();
+  if (ready_queue_max_priority () > thread_current ()->priority)
+    thread_yield ();
 }
 
 bool 
@@ -262,24 +302,54 @@ thread_compare_donate_priority (const struct list_elem *l, const struct list_ele
 void
 donate_priority (void) {
   struct thread *cur = thread_current();
-  int cur_priority = cur->priority;
 
   /* thread that will inherit the priority */
-  struct thread *holder = cur->wait_on_lock->holder;
+  donate_chain (cur->wait_on_lock->holder, cur->priority);
+}
+
+/* Raises HOLDER to PRIORITY, then whoever HOLDER waits on, and so
+   on down the chain of waits until a thread already has at least
+   PRIORITY.  A writer waiting on an rwlock's readers passes the
+   priority on to all of them. */
+static void
+donate_chain (struct thread *holder, int priority) {
 
   /* nested donation */
-  while (holder) {
-    if (holder->priority < cur_priority) {
-      holder-> priority = cur_priority;
+  while (holder != NULL && holder->priority < priority) {
+    thread_change_priority (holder, priority);
+
+    if (holder->wait_on_lock) {
+      holder = holder->wait_on_lock->holder;
     } else {
+      if (holder->wait_on_rwlock) {
+        donate_priority_to_readers (holder->wait_on_rwlock, priority);
+      }
       break;
     }
+  }
+}
 
-    if (holder->wait_on_lock) {
-      holder = holder->wait_on_lock->holder;
+/* Donates PRIORITY to every thread holding RW for reading.  An
+   rwlock does not keep track of its readers, so this looks at
+   every thread; it only happens when a writer has to wait. */
+void
+donate_priority_to_readers (struct rwlock *rw, int priority) {
+  enum intr_level old_level = intr_disable ();
+  struct list_elem *e;
+
+  for (e = list_begin (&all_list); e != list_end (&all_list); e = list_next (e)) {
+    struct thread *t = list_entry (e, struct thread, allelem);
+    int i;
+
+    for (i = 0; i < RWLOCK_READ_MAX && t->read_locks[i] != NULL; i++) {
+      if (t->read_locks[i] == rw) {
+        donate_chain (t, priority);
+        break;
+      }
     }
   }
 
+  intr_set_level (old_level);
 }
 
 void
@@ -301,27 +371,32 @@ remove_with_lock (struct lock *lock) {
 void
 refresh_priority (void) {
   struct thread *cur = thread_current();
+  int priority = cur->init_priority;
+  int i;
 
-  /* if donations is empty */
-  if (list_empty (&cur->donations)){
-    /* set priority to init_priority */
-    cur->priority = cur->init_priority;
-  } 
   /* if donations is not empty */
-  else {
+  if (!list_empty (&cur->donations)){
     list_sort (&cur->donations, thread_compare_donate_priority, 0);
 
     struct thread *front = list_entry(list_front(&cur->donations), struct thread, donation_elem);
 
-    if (front->priority > cur->init_priority) {
-      /* set priority to the highest priority of threads in donations */
-      cur->priority = front->priority;
-    } else {
-      /* set priority to init_priority */
-      cur->priority = cur->init_priority;
+    /* take the highest priority of threads in donations */
+    if (front->priority > priority) {
+      priority = front->priority;
+    }
+  }
+
+  /* writers waiting for rwlocks we are reading also donate */
+  for (i = 0; i < RWLOCK_READ_MAX && cur->read_locks[i] != NULL; i++) {
+    struct thread *writer = cur->read_locks[i]->writer;
+
+    if (writer != NULL && writer->priority > priority) {
+      priority = writer->priority;
     }
   }
 
+  /* we may be in a condition variable's wait queue already */
+  thread_change_priority (cur, priority);
 }
 
 void
@@ -333,25 +408,43 @@ calculate_priority (struct thread *t) {
     return;
   }
 
-  t->priority = fp_to_int (add_fp_int ( div_fp_int(t->recent_cpu, -4), PRI_MAX - (t->nice * 2)));
+  /* a ready thread has to move to its new queue */
+  thread_change_priority (t, mlfqs_priority (t));
 
-  if (t->priority < PRI_MIN) {
-    t->priority = PRI_MIN;
-  } else if (t->priority > PRI_MAX) {
-    t->priority = PRI_MAX;
+}
+
+/* Returns the MLFQS priority for T's recent_cpu and nice. */
+static int
+mlfqs_priority (struct thread *t) {
+  int priority = fp_to_int (add_fp_int ( div_fp_int(t->recent_cpu, -4), PRI_MAX - (t->nice * 2)));
+
+  if (priority < PRI_MIN) {
+    priority = PRI_MIN;
+  } else if (priority > PRI_MAX) {
+    priority = PRI_MAX;
   }
 
+  return priority;
 }
 
+/* Brings T's recent_cpu up to date by applying the decay of
+   every second since it was last updated. */
 void
 calculate_recent_cpu (struct thread *t) {
   if (t == idle_thread) {
     return;
   }
 
-  // int decay = div_fp (mult_fp_int (load_avg, 2), add_fp_int(mult_fp_int (load_avg, 2), 1));
+  if (mlfqs_seconds - t->recent_cpu_epoch > DECAY_HISTORY) {
+    t->recent_cpu_epoch = mlfqs_seconds - DECAY_HISTORY;
+  }
+
+  while (t->recent_cpu_epoch < mlfqs_seconds) {
+    int decay = decay_history[t->recent_cpu_epoch & (DECAY_HISTORY - 1)];
 
-  t->recent_cpu = add_fp_int(mult_fp(div_fp (mult_fp_int (load_avg, 2), add_fp_int(mult_fp_int (load_avg, 2), 1)), t->recent_cpu), t->nice);
+    t->recent_cpu = add_fp_int(mult_fp(decay, t->recent_cpu), t->nice);
+    t->recent_cpu_epoch++;
+  }
 }
 
 void
@@ -360,15 +453,20 @@ calculate_load_avg (void) {
   
   // if current thread is idle thread
   if (thread_current() == idle_thread) {
-    ready_threads = list_size(&ready_list);
+    ready_threads = ready_cnt;
   }
   // if current thread is not idle thread
   else {
-    ready_threads = list_size(&ready_list) + 1;
+    ready_threads = ready_cnt + 1;
   }
 
   load_avg = add_fp (mult_fp (div_fp (int_to_fp(59), int_to_fp(60)), load_avg),
                      mult_fp_int(div_fp(int_to_fp(1), int_to_fp(60)), ready_threads));
+
+  // record this second's decay for calculate_recent_cpu()
+  decay_history[mlfqs_seconds & (DECAY_HISTORY - 1)]
+    = div_fp (mult_fp_int (load_avg, 2), add_fp_int(mult_fp_int (load_avg, 2), 1));
+  mlfqs_seconds++;
 }
 
 void
@@ -378,23 +476,35 @@ increase_recent_cpu (void) {
   }
 }
 
+/* Decays recent_cpu and recalculates priority of the running
+   thread and of every ready thread.  Blocked threads are left
+   alone and catch up in thread_unblock(), so until then a
+   blocked thread keeps a stale MLFQS priority, including for its
+   place in a semaphore's or condition variable's wait queue. */
 void
-recalculate_all_recent_cpu (void) {
-  struct list_elem *e;
+recalculate_ready_threads (void) {
+  struct list requeue;
 
-  for (e = list_begin(&all_list); e != list_end(&all_list); e = list_next(e)) {
-    struct thread *t = list_entry (e, struct thread, allelem);
-    calculate_recent_cpu (t);
-  }
-}
+  ASSERT (intr_get_level () == INTR_OFF);
 
-void
-recalculate_all_priority (void) {
-  struct list_elem *e;
+  calculate_recent_cpu (thread_current ());
+  calculate_priority (thread_current ());
 
-  for (e = list_begin(&all_list); e != list_end(&all_list); e = list_next(e)) {
-    struct thread *t = list_entry(e, struct thread, allelem);
-    calculate_priority (t);
+  // drain the run queue, highest priority first, then put every
+  // thread back on the queue for its new priority.  a ready
+  // thread may also be in a condition variable's wait queue, so
+  // the new priority goes through thread_change_priority(), which
+  // sees popped threads as RUNNING and leaves the run queue alone
+  list_init (&requeue);
+  while (ready_cnt > 0)
+    list_push_back (&requeue, &ready_queue_pop ()->elem);
+
+  while (!list_empty (&requeue)) {
+    struct thread *t = list_entry (list_pop_front (&requeue), struct thread, elem);
+    calculate_recent_cpu (t);
+    thread_change_priority (t, mlfqs_priority (t));
+    t->status = THREAD_READY;
+    ready_queue_push (t);
   }
 }
 
@@ -402,8 +512,119 @@ recalculate_all_priority (void) {
 void
 thread_print_stats (void) 
 {
+  struct sched_stats s;
+
   printf ("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
           idle_ticks, kernel_ticks, user_ticks);
+  if (thread_cache_hits + thread_cache_misses > 0)
+    printf ("Thread: page cache %lld hits, %lld misses (%lld%% hit rate), "
+            "%lld overflows, %zu of %zu cached\n",
+            thread_cache_hits, thread_cache_misses,
+            thread_cache_hits * 100 / (thread_cache_hits + thread_cache_misses),
+            thread_cache_overflows, thread_cache_cnt, thread_cache_size);
+
+  thread_get_sched_stats (NULL, &s);
+  print_counters ("Thread", &s.all);
+  if (s.rq_samples > 0)
+    printf ("Thread: run queue length avg %"PRIu64".%02"PRIu64
+            ", max %"PRIu32" over %"PRIu64" ticks\n",
+            s.rq_len_total / s.rq_samples,
+            s.rq_len_total * 100 / s.rq_samples % 100,
+            s.rq_len_max, s.rq_samples);
+  if (s.schedule_cnt > 0)
+    printf ("Thread: %"PRIu64" schedules, avg %"PRIu64", max %"PRIu64
+            " cycles with interrupts off\n",
+            s.schedule_cnt, s.schedule_cycles / s.schedule_cnt,
+            s.schedule_cycles_max);
+}
+
+/* Prints the switch and wakeup counters in C, prefixed by
+   PREFIX.  The latency histogram is printed as a list of
+   "<2^N:COUNT" pairs for its nonempty buckets. */
+static void
+print_counters (const char *prefix, const struct sched_counters *c)
+{
+  int b;
+
+  printf ("%s: %"PRIu64" voluntary, %"PRIu64" involuntary context switches\n",
+          prefix, c->voluntary, c->involuntary);
+  if (c->wakeups == 0)
+    return;
+  printf ("%s: %"PRIu64" wakeups, latency avg %"PRIu64", max %"PRIu64
+          " cycles\n", prefix, c->wakeups, c->latency_total / c->wakeups,
+          c->latency_max);
+  printf ("%s: wakeup latency histogram:", prefix);
+  for (b = 0; b < SCHED_LAT_BUCKETS; b++)
+    if (c->latency_hist[b] != 0)
+      printf (" %s2^%d:%"PRIu32, b < SCHED_LAT_BUCKETS - 1 ? "<" : ">=",
+              SCHED_LAT_SHIFT + (b < SCHED_LAT_BUCKETS - 1 ? b : b - 1),
+              c->latency_hist[b]);
+  printf ("\n");
+}
+
+/* Fills in S with the system-wide scheduler statistics and, if T
+   is nonnull, T's own counters in S->thread. */
+void
+thread_get_sched_stats (struct thread *t, struct sched_stats *s)
+{
+  enum intr_level old_level;
+  int j;
+
+  memset (s, 0, sizeof *s);
+
+  old_level = intr_disable ();
+  s->all = sched_all;
+  s->schedule_cnt = schedule_cnt;
+  s->schedule_cycles = schedule_cycles;
+  s->schedule_cycles_max = schedule_cycles_max;
+  if (t != NULL)
+    s->thread = t->sched;
+
+  s->rq_samples = rq_samples;
+  s->rq_len_total = rq_len_total;
+  s->rq_len_max = rq_len_max;
+  for (j = 0; j < SCHED_RQ_HISTORY && j < rq_seconds; j++)
+    s->rq_history[j] = rq_history[(rq_seconds - 1 - j) % SCHED_RQ_HISTORY];
+  intr_set_level (old_level);
+}
+
+/* Records a wakeup that took LATENCY cycles to run in C. */
+static void
+record_wakeup (struct sched_counters *c, uint64_t latency)
+{
+  uint32_t hi = latency >> 32;
+  uint32_t lo = latency;
+  int log2 = hi != 0 ? 63 - __builtin_clz (hi)
+             : lo != 0 ? 31 - __builtin_clz (lo) : 0;
+  int bucket = log2 < SCHED_LAT_SHIFT ? 0 : log2 - SCHED_LAT_SHIFT + 1;
+
+  if (bucket >= SCHED_LAT_BUCKETS)
+    bucket = SCHED_LAT_BUCKETS - 1;
+  c->wakeups++;
+  c->latency_total += latency;
+  if (latency > c->latency_max)
+    c->latency_max = latency;
+  c->latency_hist[bucket]++;
+}
+
+/* Adds the current length of the run queue to the run queue
+   statistics.  Called once per timer tick. */
+static void
+sample_run_queues (void)
+{
+  uint32_t len = ready_cnt;
+
+  rq_samples++;
+  rq_len_total += len;
+  if (len > rq_len_max)
+    rq_len_max = len;
+  rq_len_second += len;
+  if (rq_samples % TIMER_FREQ == 0)
+    {
+      rq_history[rq_seconds++ % SCHED_RQ_HISTORY]
+        = rq_len_second * 100 / TIMER_FREQ;
+      rq_len_second = 0;
+    }
 }
 
 /* Creates a new kernel thread named NAME with the given initial
@@ -436,7 +657,7 @@ thread_create (const char *name, int priority,
   ASSERT (function != NULL);
 
   /* Allocate thread. */
-  t = palloc_get_page (PAL_ZERO);
+  t = alloc_thread_page ();
   if (t == NULL)
     return TID_ERROR;
 
@@ -481,10 +702,7 @@ thread_create (const char *name, int priority,
   /* Add to run queue. */
   thread_unblock (t);
 
-  // thread_test_preemption();
-  if (priority > thread_current()->priority) {
-    thread_yield();
-  }
+  thread_test_preemption ();
 
   return tid;
 }
@@ -522,9 +740,16 @@ thread_unblock (struct thread *t)
 
   old_level = intr_disable ();
   ASSERT (t->status == THREAD_BLOCKED);
-  // list_push_back (&ready_list, &t->elem);
-  list_insert_ordered(&ready_list, &t->elem, thread_compare_priority, 0);
+
+  /* Replay the recent_cpu decay T missed while blocked. */
+  if (thread_mlfqs) {
+    calculate_recent_cpu (t);
+    calculate_priority (t);
+  }
+
   t->status = THREAD_READY;
+  t->wakeup_time = cpu_cycles ();
+  ready_queue_push (t);
 
   // if (thread_current() != idle_thread && thread_current()->priority < t->priority) {
   //   thread_yield();
@@ -601,10 +826,9 @@ thread_yield (void)
   ASSERT (!intr_context ());
 
   old_level = intr_disable ();
-  if (cur != idle_thread) 
-    // list_push_back (&ready_list, &cur->elem);
-    list_insert_ordered(&ready_list, &cur -> elem, thread_compare_priority, 0);
   cur->status = THREAD_READY;
+  if (cur != idle_thread) 
+    ready_queue_push (cur);
   schedule ();
   intr_set_level (old_level);
 }
@@ -645,13 +869,7 @@ thread_set_priority (int new_priority)
 
   /* consider priority of threads in donations */
 
-  // thread_test_preemption();
-  if (!list_empty (&ready_list)) {
-    struct thread *next = list_entry(list_begin(&ready_list), struct thread, elem);
-    if (next != NULL && next->priority > new_priority) {
-      thread_yield();
-    }
-  }
+  thread_test_preemption ();
 }
 
 /* Returns the current thread's priority. */
@@ -763,6 +981,19 @@ idle (void *idle_started_ UNUSED)
       intr_disable ();
       thread_block ();
 
+      /* Zero free pages ahead of PAL_ZERO requests, a page at a
+         time, until there is enough or another thread is ready. */
+      intr_enable ();
+      while (ready_cnt == 0 && palloc_zero_idle ())
+        continue;
+      intr_disable ();
+      if (ready_cnt > 0)
+        continue;
+
+      /* With nothing to run until the next timer event, there
+         is no point taking timer interrupts before it. */
+      timer_idle_enter ();
+
       /* Re-enable interrupts and wait for the next one.
 
          The `sti' instruction disables interrupts until the
@@ -834,6 +1065,9 @@ init_thread (struct thread *t, const char *name, int priority)
   /* Initialize for advanced scheduler */
   t->nice = 0;
   t->recent_cpu = 0;
+  t->recent_cpu_epoch = mlfqs_seconds;
+
+  timer_event_init (&t->sleep_event, thread_wake_up, t);
 
   t->magic = THREAD_MAGIC;
 
@@ -845,6 +1079,9 @@ init_thread (struct thread *t, const char *name, int priority)
   lock_init (&t->lock_child);
   cond_init (&t->cond_child);
   list_init (&t->children);
+#ifdef VM
+  list_init (&t->mappings);
+#endif
 
   #endif
 
@@ -873,10 +1110,99 @@ alloc_frame (struct thread *t, size_t size)
 static struct thread *
 next_thread_to_run (void) 
 {
-  if (list_empty (&ready_list))
+  if (ready_cnt == 0)
     return idle_thread;
   else
-    return list_entry (list_pop_front (&ready_list), struct thread, elem);
+    return ready_queue_pop ();
+}
+
+/* Appends T, which must be in THREAD_READY state, to the run
+   queue for its current priority. */
+static void
+ready_queue_push (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (t->status == THREAD_READY);
+
+  list_push_back (&ready_queues[t->priority], &t->elem);
+  ready_bitmap |= (uint64_t) 1 << t->priority;
+  ready_cnt++;
+}
+
+/* Removes T from the run queue. */
+static void
+ready_queue_remove (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (t->status == THREAD_READY);
+
+  list_remove (&t->elem);
+  if (list_empty (&ready_queues[t->priority]))
+    ready_bitmap &= ~((uint64_t) 1 << t->priority);
+  ready_cnt--;
+}
+
+/* Removes and returns the first thread in the highest priority
+   nonempty run queue.  The run queue must not be empty.  The
+   thread is marked RUNNING at once, so that nobody mistakes it
+   for one still on the queue while it is being switched to. */
+static struct thread *
+ready_queue_pop (void)
+{
+  int pri = ready_queue_max_priority ();
+  struct thread *t;
+
+  ASSERT (pri >= PRI_MIN);
+
+  t = list_entry (list_front (&ready_queues[pri]), struct thread, elem);
+  ready_queue_remove (t);
+  t->status = THREAD_RUNNING;
+  return t;
+}
+
+/* Returns the priority of the highest priority ready thread, or
+   -1 if the run queue is empty.  The bitmap is split in halves
+   so that this compiles to a single BSR per half on IA-32. */
+static int
+ready_queue_max_priority (void)
+{
+  uint32_t hi = ready_bitmap >> 32;
+  uint32_t lo = ready_bitmap;
+
+  if (hi != 0)
+    return 63 - __builtin_clz (hi);
+  else if (lo != 0)
+    return 31 - __builtin_clz (lo);
+  else
+    return -1;
+}
+
+/* Sets T's effective priority to PRIORITY.  If T is waiting in
+   a run queue, moves it to the queue for its new priority, and
+   if it is waiting on a semaphore or condition variable, moves
+   it to its new place in that wait queue. */
+static void
+thread_change_priority (struct thread *t, int priority)
+{
+  enum intr_level old_level = intr_disable ();
+
+  if (t->priority != priority)
+    {
+      /* A thread in cond_wait() can be preempted, and so READY,
+         after it joins the condition variable's wait queue. */
+      bool ready = t->status == THREAD_READY;
+
+      if (ready)
+        ready_queue_remove (t);
+      if (t->wait_sema != NULL || t->wait_cond != NULL)
+        sema_change_priority (t, priority);
+      else
+        t->priority = priority;
+      if (ready)
+        ready_queue_push (t);
+    }
+
+  intr_set_level (old_level);
 }
 
 /* Completes a thread switch by activating the new thread's page
@@ -899,6 +1225,7 @@ void
 thread_schedule_tail (struct thread *prev)
 {
   struct thread *cur = running_thread ();
+  uint64_t cycles;
   
   ASSERT (intr_get_level () == INTR_OFF);
 
@@ -908,6 +1235,16 @@ thread_schedule_tail (struct thread *prev)
   /* Start new time slice. */
   thread_ticks = 0;
 
+  /* Account for the wait since CUR was woken up, if it was. */
+  if (cur->wakeup_time != 0)
+    {
+      uint64_t latency = cpu_cycles () - cur->wakeup_time;
+
+      record_wakeup (&cur->sched, latency);
+      record_wakeup (&sched_all, latency);
+      cur->wakeup_time = 0;
+    }
+
 #ifdef USERPROG
   /* Activate the new address space. */
   process_activate ();
@@ -921,8 +1258,15 @@ thread_schedule_tail (struct thread *prev)
   if (prev != NULL && prev->status == THREAD_DYING && prev != initial_thread) 
     {
       ASSERT (prev != cur);
-      palloc_free_page (prev);
+      free_thread_page (prev);
     }
+
+  /* Account for the time spent switching. */
+  cycles = cpu_cycles () - schedule_start;
+  schedule_cnt++;
+  schedule_cycles += cycles;
+  if (cycles > schedule_cycles_max)
+    schedule_cycles_max = cycles;
 }
 
 /* Schedules a new process.  At entry, interrupts must be off and
@@ -936,18 +1280,127 @@ static void
 schedule (void) 
 {
   struct thread *cur = running_thread ();
+  uint64_t start = cpu_cycles ();
   struct thread *next = next_thread_to_run ();
   struct thread *prev = NULL;
 
   ASSERT (intr_get_level () == INTR_OFF);
-  ASSERT (cur->status != THREAD_RUNNING);
+  ASSERT (cur->status != THREAD_RUNNING || cur == next);
   ASSERT (is_thread (next));
 
+  /* Account for timer ticks skipped while idle. */
+  if (cur == idle_thread)
+    idle_ticks += timer_idle_exit ();
+
+  schedule_start = start;
   if (cur != next)
-    prev = switch_threads (cur, next);
+    {
+      /* A thread that is still ready was preempted; any other
+         gave up the CPU to wait or exit. */
+      if (cur->status == THREAD_READY)
+        {
+          cur->sched.involuntary++;
+          sched_all.involuntary++;
+        }
+      else
+        {
+          cur->sched.voluntary++;
+          sched_all.voluntary++;
+        }
+      prev = switch_threads (cur, next);
+    }
   thread_schedule_tail (prev);
 }
 
+/* Returns a page for a new thread, from the thread page cache
+   if it is not empty, otherwise from the page allocator.
+   Returns a null pointer if no page is available.  The page's
+   contents are unspecified. */
+static struct thread *
+alloc_thread_page (void)
+{
+  struct thread *t = NULL;
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  spinlock_acquire (&thread_cache_lock);
+  if (thread_cache_cnt > 0)
+    {
+      t = list_entry (list_pop_front (&thread_cache), struct thread, elem);
+      thread_cache_cnt--;
+      thread_cache_hits++;
+    }
+  else
+    thread_cache_misses++;
+  spinlock_release (&thread_cache_lock);
+  intr_set_level (old_level);
+
+  if (t == NULL)
+    t = palloc_get_page (0);
+  return t;
+}
+
+/* Puts dead thread T's page in the thread page cache, or frees
+   it if the cache already holds thread_cache_size pages.
+   Interrupts must be off. */
+static void
+free_thread_page (struct thread *t)
+{
+  bool cached = false;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (t->status == THREAD_DYING);
+
+  spinlock_acquire (&thread_cache_lock);
+  if (thread_cache_cnt < thread_cache_size)
+    {
+      list_push_front (&thread_cache, &t->elem);
+      thread_cache_cnt++;
+      cached = true;
+    }
+  else
+    thread_cache_overflows++;
+  spinlock_release (&thread_cache_lock);
+
+  if (!cached)
+    palloc_free_page (t);
+}
+
+/* Shrinker count function for the thread page cache. */
+static size_t
+thread_cache_count (void *aux UNUSED)
+{
+  return thread_cache_cnt;
+}
+
+/* Shrinker scan function for the thread page cache: frees up
+   to PAGE_CNT cached pages and returns the number freed. */
+static size_t
+thread_cache_scan (size_t page_cnt, void *aux UNUSED)
+{
+  struct list victims;
+  enum intr_level old_level;
+  size_t cnt = 0;
+
+  list_init (&victims);
+
+  old_level = intr_disable ();
+  spinlock_acquire (&thread_cache_lock);
+  while (thread_cache_cnt > 0 && cnt < page_cnt)
+    {
+      list_push_back (&victims, list_pop_front (&thread_cache));
+      thread_cache_cnt--;
+      cnt++;
+    }
+  spinlock_release (&thread_cache_lock);
+  intr_set_level (old_level);
+
+  while (!list_empty (&victims))
+    palloc_free_page (list_entry (list_pop_front (&victims),
+                                  struct thread, elem));
+  return cnt;
+}
+
 /* Returns a tid to use for a new thread. */
 static tid_t
 allocate_tid (void) 
@@ -3,8 +3,14 @@
 
 #include <debug.h>
 #include <list.h>
+#include <sched-stats.h>
 #include <stdint.h>
 #include "threads/synch.h"
+#include "devices/timer.h"
+#ifdef VM
+#include <hash.h>
+#include "vm/page.h"
+#endif
 
 /* States in a thread's life cycle. */
 enum thread_status
@@ -24,6 +30,7 @@ typedef int tid_t;
 #define PRI_MIN 0                       /* Lowest priority. */
 #define PRI_DEFAULT 31                  /* Default priority. */
 #define PRI_MAX 63                      /* Highest priority. */
+#define PRI_CNT (PRI_MAX - PRI_MIN + 1) /* # of priority levels. */
 
 /* A kernel thread or user process.
 
@@ -75,12 +82,11 @@ typedef int tid_t;
    the `magic' member of the running thread's `struct thread' is
    set to THREAD_MAGIC.  Stack overflow will normally change this
    value, triggering the assertion. */
-/* The `elem' member has a dual purpose.  It can be an element in
-   the run queue (thread.c), or it can be an element in a
-   semaphore wait list (synch.c).  It can be used these two ways
-   only because they are mutually exclusive: only a thread in the
-   ready state is on the run queue, whereas only a thread in the
-   blocked state is on a semaphore wait list. */
+/* The `elem' member is an element in the run queue (thread.c).
+   A blocked thread instead waits in a semaphore's wait queue
+   (synch.c) through `wait_elem', and if it is waiting on a
+   condition variable, also in the condition variable's wait
+   queue through a struct semaphore_elem on its stack. */
 struct thread
   {
     /* Owned by thread.c. */
@@ -90,20 +96,31 @@ struct thread
     uint8_t *stack;                     /* Saved stack pointer. */
     int priority;                       /* Priority. */
     struct list_elem allelem;           /* List element for all threads list. */
+    struct sched_counters sched;        /* Context switch statistics. */
+    uint64_t wakeup_time;               /* Cycle count when last unblocked. */
 
    /* for alarm*/
    int64_t local_tick;                  /* tick for wake up */
+   struct timer_event sleep_event;      /* wakes the thread at local_tick */
 
    int init_priority;                   /* for keep original priority */
    struct lock *wait_on_lock;           /* lock that thread is waiting for get */
+   struct rwlock *wait_on_rwlock;       /* rwlock whose readers this writer waits on */
+   struct rwlock *read_locks[RWLOCK_READ_MAX]; /* rwlocks held for reading */
    struct list donations;               /* list of threads that donate their priority */
    struct list_elem donation_elem;      /* element for manage the list donations */
 
    int nice;                            /* value for nice */
    int recent_cpu;                      /* value for recent_cpu */
+   int64_t recent_cpu_epoch;            /* second recent_cpu is decayed up to */
 
     /* Shared between thread.c and synch.c. */
     struct list_elem elem;              /* List element. */
+    struct heap_elem wait_elem;         /* Semaphore wait queue element. */
+    unsigned wait_seq;                  /* Arrival order in wait queue. */
+    struct semaphore *wait_sema;        /* Semaphore waited on, if any. */
+    struct condition *wait_cond;        /* Condition waited on, if any. */
+    struct heap_elem *wait_cond_elem;   /* Element in wait_cond's queue. */
 
 #ifdef USERPROG
     /* Owned by userprog/process.c. */
@@ -136,6 +153,18 @@ struct thread
     // pt 2-3 fdt imp
     struct fdt *t_fdt;
   
+#ifdef VM
+    /* Owned by vm/page.c. */
+    struct hash pages;                  /* Supplemental page table. */
+    struct page_faults faults;          /* Fault-around and counters. */
+
+    /* Owned by userprog/syscall.c. */
+    void *user_esp;                     /* User stack pointer in system call. */
+
+    /* Owned by vm/mmap.c. */
+    struct list mappings;               /* Memory-mapped files. */
+    int next_mapping;                   /* Next mapping identifier. */
+#endif
 
 #endif
 
@@ -167,6 +196,12 @@ struct fdt
 //    };
    
 
+/* Maximum number of pages of exited threads kept for reuse by
+   thread_create().  Controlled by kernel command-line option
+   "-tcache=N". */
+#define THREAD_CACHE_DEFAULT 8
+extern size_t thread_cache_size;
+
 /* If false (default), use round-robin scheduler.
    If true, use multi-level feedback queue scheduler.
    Controlled by kernel command-line option "-o mlfqs". */
@@ -177,6 +212,7 @@ void thread_start (void);
 
 void thread_tick (void);
 void thread_print_stats (void);
+void thread_get_sched_stats (struct thread *, struct sched_stats *);
 
 typedef void thread_func (void *aux);
 tid_t thread_create (const char *name, int priority, thread_func *, void *);
@@ -184,19 +220,21 @@ tid_t thread_create (const char *name, int priority, thread_func *, void *);
 void thread_block (void);
 void thread_unblock (struct thread *);
 
+void thread_exit (void) NO_RETURN;
+void thread_yield (void);
+
 struct thread *thread_current (void);
 tid_t thread_tid (void);
 const char *thread_name (void);
 
 void thread_sleep(int64_t ticks);
-void thread_wake_up(int64_t ticks);
 
-bool thread_compare_priority (struct list_elem *list_elem, struct list_elem *e, void *aux);
 void thread_test_preemption (void);
 
 bool thread_compare_donate_priority (const struct list_elem *l, const struct list_elem *s, void *aux);
 
 void donate_priority (void);
+void donate_priority_to_readers (struct rwlock *rw, int priority);
 
 void remove_with_lock (struct lock *lock);
 void refresh_priority (void);
@@ -206,11 +244,7 @@ void calculate_recent_cpu (struct thread *t);
 void calculate_load_avg (void);
 
 void increase_recent_cpu (void);
-void recalculate_all_priority (void);
-void recalculate_all_recent_cpu (void);
-
-// get global tick
-int64_t get_global_tick(void);
+void recalculate_ready_threads (void);
 
 /* Performs some operation on thread t, given auxiliary data AUX. */
 typedef void thread_action_func (struct thread *t, void *aux);
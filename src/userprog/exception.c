@@ -6,6 +6,9 @@
 #include "threads/thread.h"
 #include "userprog/pagedir.h"
 #include "threads/vaddr.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 /* Number of page faults processed. */
 static long long page_fault_cnt;
@@ -148,14 +151,36 @@ page_fault (struct intr_frame *f)
   /* Count page faults. */
   page_fault_cnt++;
 
-  exit(-1);
-
   /* Determine cause. */
   not_present = (f->error_code & PF_P) == 0;
   write = (f->error_code & PF_W) != 0;
   user = (f->error_code & PF_U) != 0;
 
-  
+#ifdef VM
+  /* Bring in a page of the process that has not been loaded
+     yet, whether the process touched it or the kernel did on its
+     behalf. */
+  if (not_present && is_user_vaddr (fault_addr)
+      && page_fault_load (fault_addr))
+    return;
+
+  /* Grow the stack, if that is what the process seems to be
+     doing.  On a fault in the kernel, f->esp is the kernel's
+     stack pointer, so use the one saved at the start of the
+     system call. */
+  if (not_present && is_user_vaddr (fault_addr)
+      && page_grow_stack (fault_addr,
+                          user ? f->esp : thread_current ()->user_esp))
+    return;
+
+  /* Give the process its own copy of a page that it shares with
+     another since fork(), the first time it writes to it. */
+  if (!not_present && write && is_user_vaddr (fault_addr)
+      && page_unshare (fault_addr))
+    return;
+#endif
+
+  exit(-1);
 
   // exit (-1);
 
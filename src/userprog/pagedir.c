@@ -6,8 +6,19 @@
 #include "threads/pte.h"
 #include "threads/palloc.h"
 
+/* Map big user segments with 4 MB pages? */
+bool pagedir_large_pages;
+
+/* Above this many pages, pagedir_invalidate_range() flushes the
+   whole TLB instead of invalidating pages one by one.  Kernel
+   mappings are global, so a full flush only costs the user
+   entries. */
+#define INVLPG_MAX 32
+
 static uint32_t *active_pd (void);
+static void load_pagedir (uint32_t *);
 static void invalidate_pagedir (uint32_t *);
+static void invalidate_page (uint32_t *, const void *);
 
 /* Creates a new page directory that has mappings for kernel
    virtual addresses, but none for user virtual addresses.
@@ -34,7 +45,9 @@ pagedir_destroy (uint32_t *pd)
 
   ASSERT (pd != init_page_dir);
   for (pde = pd; pde < pd + pd_no (PHYS_BASE); pde++)
-    if (*pde & PTE_P) 
+    if ((*pde & (PTE_P | PTE_PS)) == (PTE_P | PTE_PS))
+      palloc_free_multiple (pde_get_large_page (*pde), LARGE_PAGE_CNT);
+    else if (*pde & PTE_P) 
       {
         uint32_t *pt = pde_get_pt (*pde);
         uint32_t *pte;
@@ -47,12 +60,22 @@ pagedir_destroy (uint32_t *pd)
   palloc_free_page (pd);
 }
 
+/* Returns true if PTE, returned by lookup_page() for PD, is the
+   PDE of a large page rather than a PTE. */
+static inline bool
+is_large (uint32_t *pd, uint32_t *pte)
+{
+  return pte >= pd && pte < pd + PGSIZE / sizeof *pd;
+}
+
 /* Returns the address of the page table entry for virtual
    address VADDR in page directory PD.
    If PD does not have a page table for VADDR, behavior depends
    on CREATE.  If CREATE is true, then a new page table is
    created and a pointer into it is returned.  Otherwise, a null
-   pointer is returned. */
+   pointer is returned.
+   If VADDR is in a 4 MB large page, returns its PDE, which has
+   the same flags as a PTE. */
 static uint32_t *
 lookup_page (uint32_t *pd, const void *vaddr, bool create)
 {
@@ -66,6 +89,8 @@ lookup_page (uint32_t *pd, const void *vaddr, bool create)
   /* Check for a page table for VADDR.
      If one is missing, create one if requested. */
   pde = pd + pd_no (vaddr);
+  if (*pde & PTE_PS)
+    return pde;
   if (*pde == 0) 
     {
       if (create)
@@ -118,6 +143,34 @@ pagedir_set_page (uint32_t *pd, void *upage, void *kpage, bool writable)
     return false;
 }
 
+/* Adds a mapping in page directory PD from the 4 MB of user
+   virtual memory starting at UPAGE to the large page identified
+   by kernel virtual address KPAGE.  UPAGE must be 4 MB aligned,
+   and KPAGE must be LARGE_PAGE_CNT pages obtained together from
+   the user pool with palloc_get_multiple(), which makes them 4 MB
+   aligned.  Large pages must be enabled.
+   If WRITABLE is true, the new page is read/write;
+   otherwise it is read-only.
+   Returns false if any of the 4 MB is already mapped. */
+bool
+pagedir_set_large_page (uint32_t *pd, void *upage, void *kpage,
+                        bool writable)
+{
+  uint32_t *pde;
+
+  ASSERT (init_pse);
+  ASSERT (((uintptr_t) upage & ~PDE_LARGE_ADDR) == 0);
+  ASSERT (is_user_vaddr (upage));
+  ASSERT (vtop (kpage) / PGSIZE + LARGE_PAGE_CNT <= init_ram_pages);
+  ASSERT (pd != init_page_dir);
+
+  pde = pd + pd_no (upage);
+  if (*pde != 0)
+    return false;
+  *pde = pde_create_large (kpage, writable) | PTE_U;
+  return true;
+}
+
 /* Looks up the physical address that corresponds to user virtual
    address UADDR in PD.  Returns the kernel virtual address
    corresponding to that physical address, or a null pointer if
@@ -130,16 +183,20 @@ pagedir_get_page (uint32_t *pd, const void *uaddr)
   ASSERT (is_user_vaddr (uaddr));
   
   pte = lookup_page (pd, uaddr, false);
-  if (pte != NULL && (*pte & PTE_P) != 0)
-    return pte_get_page (*pte) + pg_ofs (uaddr);
-  else
+  if (pte == NULL || (*pte & PTE_P) == 0)
     return NULL;
+  else if (is_large (pd, pte))
+    return (uint8_t *) pde_get_large_page (*pte)
+           + ((uintptr_t) uaddr & ~PDE_LARGE_ADDR);
+  else
+    return pte_get_page (*pte) + pg_ofs (uaddr);
 }
 
 /* Marks user virtual page UPAGE "not present" in page
    directory PD.  Later accesses to the page will fault.  Other
    bits in the page table entry are preserved.
-   UPAGE need not be mapped. */
+   UPAGE need not be mapped.  If it is in a large page, the whole
+   large page becomes not present. */
 void
 pagedir_clear_page (uint32_t *pd, void *upage) 
 {
@@ -152,10 +209,57 @@ pagedir_clear_page (uint32_t *pd, void *upage)
   if (pte != NULL && (*pte & PTE_P) != 0)
     {
       *pte &= ~PTE_P;
-      invalidate_pagedir (pd);
+      invalidate_page (pd, upage);
     }
 }
 
+/* Marks the PAGE_CNT user virtual pages starting at UPAGE "not
+   present" in page directory PD, like pagedir_clear_page(), but
+   updates the TLB only once for all of them. */
+void
+pagedir_clear_range (uint32_t *pd, void *upage, size_t page_cnt)
+{
+  uint8_t *page;
+  size_t i;
+
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (is_user_vaddr ((uint8_t *) upage + (page_cnt - 1) * PGSIZE));
+
+  for (i = 0, page = upage; i < page_cnt; i++, page += PGSIZE)
+    {
+      uint32_t *pte = lookup_page (pd, page, false);
+      if (pte != NULL)
+        *pte &= ~PTE_P;
+    }
+  pagedir_invalidate_range (pd, upage, page_cnt);
+}
+
+/* Copies each 4 MB large page of user memory mapped in page
+   directory SRC into a new large page, mapped at the same
+   address and with the same permissions in page directory DST.
+   Returns true if successful, false if memory allocation
+   failed. */
+bool
+pagedir_copy_large_pages (uint32_t *dst, uint32_t *src)
+{
+  uint32_t *pde;
+
+  ASSERT (dst != init_page_dir);
+
+  for (pde = src; pde < src + pd_no (PHYS_BASE); pde++)
+    if ((*pde & (PTE_P | PTE_PS)) == (PTE_P | PTE_PS))
+      {
+        uint8_t *kpage = palloc_get_multiple (PAL_USER, LARGE_PAGE_CNT);
+
+        if (kpage == NULL)
+          return false;
+        ASSERT (dst[pde - src] == 0);
+        memcpy (kpage, pde_get_large_page (*pde), PTSPAN);
+        dst[pde - src] = pde_create_large (kpage, (*pde & PTE_W) != 0) | PTE_U;
+      }
+  return true;
+}
+
 /* Returns true if the PTE for virtual page VPAGE in PD is dirty,
    that is, if the page has been modified since the PTE was
    installed.
@@ -180,11 +284,27 @@ pagedir_set_dirty (uint32_t *pd, const void *vpage, bool dirty)
       else 
         {
           *pte &= ~(uint32_t) PTE_D;
-          invalidate_pagedir (pd);
+          invalidate_page (pd, vpage);
         }
     }
 }
 
+/* Makes the PTE for virtual page VPAGE in PD read/write if
+   WRITABLE is true, read-only otherwise. */
+void
+pagedir_set_writable (uint32_t *pd, const void *vpage, bool writable)
+{
+  uint32_t *pte = lookup_page (pd, vpage, false);
+  if (pte != NULL)
+    {
+      if (writable)
+        *pte |= PTE_W;
+      else
+        *pte &= ~(uint32_t) PTE_W;
+      invalidate_page (pd, vpage);
+    }
+}
+
 /* Returns true if the PTE for virtual page VPAGE in PD has been
    accessed recently, that is, between the time the PTE was
    installed and the last time it was cleared.  Returns false if
@@ -209,25 +329,46 @@ pagedir_set_accessed (uint32_t *pd, const void *vpage, bool accessed)
       else 
         {
           *pte &= ~(uint32_t) PTE_A; 
-          invalidate_pagedir (pd);
+          invalidate_page (pd, vpage);
         }
     }
 }
 
 /* Loads page directory PD into the CPU's page directory base
-   register. */
+   register, unless it is already there.  Switching page
+   directories flushes the TLB entries for user pages but not
+   for the kernel's, which are global. */
 void
 pagedir_activate (uint32_t *pd) 
 {
   if (pd == NULL)
     pd = init_page_dir;
 
-  /* Store the physical address of the page directory into CR3
-     aka PDBR (page directory base register).  This activates our
-     new page tables immediately.  See [IA32-v2a] "MOV--Move
-     to/from Control Registers" and [IA32-v3a] 3.7.5 "Base
-     Address of the Page Directory". */
-  asm volatile ("movl %0, %%cr3" : : "r" (vtop (pd)) : "memory");
+  if (active_pd () != pd)
+    load_pagedir (pd);
+}
+
+/* Brings the TLB up to date after changes to the PTEs for all
+   of the user pages in PD. */
+void
+pagedir_flush_user (uint32_t *pd)
+{
+  invalidate_pagedir (pd);
+}
+
+/* Brings the TLB up to date after changes to the PTEs for the
+   PAGE_CNT user virtual pages starting at UPAGE in PD. */
+void
+pagedir_invalidate_range (uint32_t *pd, const void *upage, size_t page_cnt)
+{
+  const uint8_t *page = upage;
+  size_t i;
+
+  if (page_cnt > INVLPG_MAX)
+    invalidate_pagedir (pd);
+  else if (active_pd () == pd)
+    for (i = 0; i < page_cnt; i++, page += PGSIZE)
+      asm volatile ("invlpg (%0)" : : "r" (page) : "memory");
 }
 
 /* Returns the currently active page directory. */
@@ -243,6 +384,17 @@ active_pd (void)
   return ptov (pd);
 }
 
+/* Stores the physical address of page directory PD into CR3
+   aka PDBR (page directory base register).  This activates PD
+   immediately and flushes all non-global TLB entries.  See
+   [IA32-v2a] "MOV--Move to/from Control Registers" and
+   [IA32-v3a] 3.7.5 "Base Address of the Page Directory". */
+static void
+load_pagedir (uint32_t *pd)
+{
+  asm volatile ("movl %0, %%cr3" : : "r" (vtop (pd)) : "memory");
+}
+
 /* Seom page table changes can cause the CPU's translation
    lookaside buffer (TLB) to become out-of-sync with the page
    table.  When this happens, we have to "invalidate" the TLB by
@@ -256,8 +408,19 @@ invalidate_pagedir (uint32_t *pd)
 {
   if (active_pd () == pd) 
     {
-      /* Re-activating PD clears the TLB.  See [IA32-v3a] 3.12
+      /* Reloading CR3 clears the TLB.  See [IA32-v3a] 3.12
          "Translation Lookaside Buffers (TLBs)". */
-      pagedir_activate (pd);
+      load_pagedir (pd);
     } 
 }
+
+/* Invalidates the TLB entry for virtual page VPAGE if PD is the
+   active page directory.  For a page in a large page, this
+   invalidates the whole large page's entry.  See [IA32-v2a]
+   "INVLPG". */
+static void
+invalidate_page (uint32_t *pd, const void *vpage)
+{
+  if (active_pd () == pd)
+    asm volatile ("invlpg (%0)" : : "r" (vpage) : "memory");
+}
@@ -7,6 +7,7 @@
 #include <string.h>
 #include "userprog/gdt.h"
 #include "userprog/pagedir.h"
+#include "userprog/syscall.h"
 #include "userprog/tss.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
@@ -15,15 +16,34 @@
 #include "threads/init.h"
 #include "threads/interrupt.h"
 #include "threads/palloc.h"
+#include "threads/pte.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "threads/synch.h"
+#include "threads/slab.h"
+#ifdef VM
+#include "vm/mmap.h"
+#include "vm/page.h"
+#endif
 
+/* Cache of `struct child_status'. */
+static struct kmem_cache child_cache;
 
 static thread_func start_process NO_RETURN;
+#ifdef VM
+static thread_func fork_process NO_RETURN;
+#endif
 static bool load (const char *cmdline, void (**eip) (void), void **esp);
 static void argument_stack(const char **argv, int argc, void **esp);
 
+/* Initializes the process module. */
+void
+process_init (void)
+{
+  kmem_cache_init (&child_cache, "child_status",
+                   sizeof (struct child_status), NULL);
+}
+
 /* jh 추가 함수1 */
 // static void argument_stack(const char **argv, int argc, void **esp)
 // {
@@ -138,7 +158,7 @@ process_execute (const char *file_name)
   else
   {
     cur = thread_current();
-    child = calloc(1, sizeof(*child));
+    child = kmem_cache_zalloc(&child_cache);
 
     if(child != NULL)
     {
@@ -253,6 +273,114 @@ start_process (void *file_name_)
   NOT_REACHED ();
 }
 
+#ifdef VM
+/* Passed by process_fork() to fork_process(). */
+struct fork_info
+  {
+    struct thread *parent;      /* Process calling fork(). */
+    struct intr_frame if_;      /* Its user context. */
+    struct semaphore done;      /* Upped once the child is set up. */
+    bool success;               /* Was the child set up? */
+  };
+
+/* Starts a new thread running a copy of the current process,
+   which returns to user mode through a copy of IF_, but with 0
+   as the value of fork().  The child shares each page that its
+   parent has in memory until either of them writes to it (see
+   vm/page.c), and has its own copy of each file and mapping
+   that its parent has open.  Returns the child's thread id, or
+   TID_ERROR if it cannot be created. */
+tid_t
+process_fork (const struct intr_frame *if_)
+{
+  struct thread *cur = thread_current ();
+  struct fork_info info;
+  tid_t tid;
+
+  info.parent = cur;
+  info.if_ = *if_;
+  sema_init (&info.done, 0);
+  info.success = false;
+
+  tid = thread_create (cur->name, PRI_DEFAULT, fork_process, &info);
+  if (tid == TID_ERROR)
+    return TID_ERROR;
+  sema_down (&info.done);
+
+  /* The child made our pages read-only, but if we did not block
+     above, the TLB may still allow writing to them. */
+  pagedir_flush_user (cur->pagedir);
+  return info.success ? tid : TID_ERROR;
+}
+
+/* A thread function that makes the new thread a copy of the
+   process in INFO_, which waits for it, and starts it
+   running. */
+static void
+fork_process (void *info_)
+{
+  struct fork_info *info = info_;
+  struct thread *parent = info->parent;
+  struct thread *cur = thread_current ();
+  struct intr_frame if_ = info->if_;
+  struct child_status *child = NULL;
+  bool success = false;
+
+  cur->parent_id = parent->tid;
+
+  /* Allocate and activate page directory. */
+  cur->pagedir = pagedir_create ();
+  if (cur->pagedir == NULL)
+    goto done;
+  if (!page_table_create (&cur->pages))
+    {
+      pagedir_destroy (cur->pagedir);
+      cur->pagedir = NULL;
+      goto done;
+    }
+  process_activate ();
+
+  cur->exec_file = file_reopen (parent->exec_file);
+  if (cur->exec_file == NULL)
+    goto done;
+  file_deny_write (cur->exec_file);
+
+  /* Copy the address space and open files. */
+  child = kmem_cache_zalloc (&child_cache);
+  success = (child != NULL
+             && pagedir_copy_large_pages (cur->pagedir, parent->pagedir)
+             && page_table_copy (parent)
+             && mmap_copy (parent)
+             && copy_files_by_owner (parent->tid, cur->tid));
+
+  /* Let the parent wait for us.  It is blocked until we are
+     done, so only its other children could touch its list. */
+  if (success)
+    {
+      child->child_id = cur->tid;
+      lock_acquire (&parent->lock_child);
+      list_push_back (&parent->children, &child->child_elem);
+      lock_release (&parent->lock_child);
+    }
+  else if (child != NULL)
+    kmem_cache_free (&child_cache, child);
+
+ done:
+  /* INFO is on the parent's stack, so it is gone once we wake
+     the parent. */
+  info->success = success;
+  sema_up (&info->done);
+  if (!success)
+    thread_exit ();
+
+  /* Return to user mode as start_process() does. */
+  if_.eax = 0;
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+
+  NOT_REACHED ();
+}
+#endif
+
 /* Waits for thread TID to die and returns its exit status.  If
    it was terminated by the kernel (i.e. killed due to an
    exception), returns -1.  If TID is invalid or if it was not a
@@ -348,6 +476,12 @@ process_exit (void)
   pd = cur->pagedir;
   if (pd != NULL) 
     {
+#ifdef VM
+      /* Write back mapped files while the pages are still
+         reachable. */
+      mmap_unmap_all ();
+#endif
+
       /* Correct ordering here is crucial.  We must set
          cur->pagedir to NULL before switching page directories,
          so that a timer interrupt can't switch back to the
@@ -357,6 +491,9 @@ process_exit (void)
          that's been freed (and cleared). */
       cur->pagedir = NULL;
       pagedir_activate (NULL);
+#ifdef VM
+      page_table_destroy (&cur->pages);
+#endif
       pagedir_destroy (pd);
     }
   
@@ -368,12 +505,19 @@ process_exit (void)
     next = list_next (e);
     child = list_entry (e, struct child_status, child_elem);
     list_remove (e);
-    free (child);
+    kmem_cache_free (&child_cache, child);
     e = next;
   }
 
+#ifdef VM
+  /* The executable stayed open for demand paging.  Closing it
+     allows writes to it again. */
+  file_close (cur->exec_file);
+  cur->exec_file = NULL;
+#else
   if (cur->exec_file != NULL)
     file_allow_write (cur->exec_file);
+#endif
 
   close_file_by_owner(cur->tid);
   
@@ -495,6 +639,14 @@ load (const char *file_name, void (**eip) (void), void **esp)
   t->pagedir = pagedir_create ();
   if (t->pagedir == NULL) 
     goto done;
+#ifdef VM
+  if (!page_table_create (&t->pages))
+    {
+      pagedir_destroy (t->pagedir);
+      t->pagedir = NULL;
+      goto done;
+    }
+#endif
   process_activate ();
 
   /* Open executable file. */
@@ -604,7 +756,19 @@ load (const char *file_name, void (**eip) (void), void **esp)
 
  done:
   /* We arrive here whether the load is successful or not. */
+#ifdef VM
+  /* Segments are read in on demand, so on success keep the
+     executable open, and unchanged, until the process exits. */
+  if (success)
+    {
+      file_deny_write (file);
+      t->exec_file = file;
+    }
+  else
+    file_close (file);
+#else
   file_close (file);
+#endif
 
   // pt 2-3
   // file_allow_write(file);
@@ -615,7 +779,9 @@ load (const char *file_name, void (**eip) (void), void **esp)
 
 /* load() helpers. */
 
+#ifndef VM
 static bool install_page (void *upage, void *kpage, bool writable);
+#endif
 
 /* Checks whether PHDR describes a valid, loadable segment in
    FILE and returns true if so, false otherwise. */
@@ -674,6 +840,12 @@ validate_segment (const struct Elf32_Phdr *phdr, struct file *file)
    The pages initialized by this function must be writable by the
    user process if WRITABLE is true, read-only otherwise.
 
+   With large pages enabled, each whole, aligned 4 MB of the
+   segment is loaded into a 4 MB large page if one is available.
+   Otherwise, with VM, each page is only recorded in the
+   supplemental page table, to be read in when the process first
+   touches it.
+
    Return true if successful, false if a memory allocation error
    or disk read error occurs. */
 static bool
@@ -684,22 +856,58 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
   ASSERT (pg_ofs (upage) == 0);
   ASSERT (ofs % PGSIZE == 0);
 
-  file_seek (file, ofs);
   while (read_bytes > 0 || zero_bytes > 0) 
     {
+      size_t page_read_bytes, page_zero_bytes;
+      uint8_t *kpage;
+
+      /* Try to load a whole 4 MB large page. */
+      if (pagedir_large_pages && init_pse
+          && ((uintptr_t) upage & ~PDE_LARGE_ADDR) == 0
+          && read_bytes + zero_bytes >= PTSPAN
+          && (kpage = palloc_get_multiple (PAL_USER, LARGE_PAGE_CNT)) != NULL)
+        {
+          page_read_bytes = read_bytes < PTSPAN ? read_bytes : PTSPAN;
+          page_zero_bytes = PTSPAN - page_read_bytes;
+          if (file_read_at (file, kpage, page_read_bytes, ofs)
+              != (int) page_read_bytes)
+            {
+              palloc_free_multiple (kpage, LARGE_PAGE_CNT);
+              return false;
+            }
+          memset (kpage + page_read_bytes, 0, page_zero_bytes);
+          if (!pagedir_set_large_page (thread_current ()->pagedir, upage,
+                                       kpage, writable))
+            {
+              palloc_free_multiple (kpage, LARGE_PAGE_CNT);
+              return false;
+            }
+          read_bytes -= page_read_bytes;
+          zero_bytes -= page_zero_bytes;
+          ofs += page_read_bytes;
+          upage += PTSPAN;
+          continue;
+        }
+
       /* Calculate how to fill this page.
          We will read PAGE_READ_BYTES bytes from FILE
          and zero the final PAGE_ZERO_BYTES bytes. */
-      size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
-      size_t page_zero_bytes = PGSIZE - page_read_bytes;
+      page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
+      page_zero_bytes = PGSIZE - page_read_bytes;
 
+#ifdef VM
+      /* Leave loading the page to the page fault handler. */
+      if (!page_add_file (upage, file, ofs, page_read_bytes, writable))
+        return false;
+#else
       /* Get a page of memory. */
-      uint8_t *kpage = palloc_get_page (PAL_USER);
+      kpage = palloc_get_page (PAL_USER);
       if (kpage == NULL)
         return false;
 
       /* Load this page. */
-      if (file_read (file, kpage, page_read_bytes) != (int) page_read_bytes)
+      if (file_read_at (file, kpage, page_read_bytes, ofs)
+          != (int) page_read_bytes)
         {
           palloc_free_page (kpage);
           return false; 
@@ -712,10 +920,12 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
           palloc_free_page (kpage);
           return false; 
         }
+#endif
 
       /* Advance. */
       read_bytes -= page_read_bytes;
       zero_bytes -= page_zero_bytes;
+      ofs += page_read_bytes;
       upage += PGSIZE;
     }
   return true;
@@ -726,10 +936,17 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
 static bool
 setup_stack (void **esp, char * file_name) 
 {
-  uint8_t *kpage;
   bool success = false;
 
-  kpage = palloc_get_page (PAL_USER | PAL_ZERO);
+#ifdef VM
+  /* The stack page is written right away, so load it now. */
+  uint8_t *upage = ((uint8_t *) PHYS_BASE) - PGSIZE;
+
+  success = page_add_zero (upage, true) && page_load (upage);
+  if (success)
+    *esp = PHYS_BASE;
+#else
+  uint8_t *kpage = palloc_get_page (PAL_USER | PAL_ZERO);
   if (kpage != NULL) 
     {
       success = install_page (((uint8_t *) PHYS_BASE) - PGSIZE, kpage, true);
@@ -738,6 +955,7 @@ setup_stack (void **esp, char * file_name)
       else
         palloc_free_page (kpage);
     }
+#endif
 
   char *token;
   char *save_ptr;
@@ -797,6 +1015,7 @@ setup_stack (void **esp, char * file_name)
   return success;
 }
 
+#ifndef VM
 /* Adds a mapping from user virtual address UPAGE to kernel
    virtual address KPAGE to the page table.
    If WRITABLE is true, the user process may modify the page;
@@ -816,3 +1035,4 @@ install_page (void *upage, void *kpage, bool writable)
   return (pagedir_get_page (t->pagedir, upage) == NULL
           && pagedir_set_page (t->pagedir, upage, kpage, writable));
 }
+#endif
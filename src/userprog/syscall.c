@@ -4,12 +4,19 @@
 #include "threads/interrupt.h"
 #include "threads/vaddr.h"
 #include "userprog/pagedir.h"
+#include "userprog/process.h"
 #include "devices/shutdown.h"
 #include "filesys/filesys.h"
-#include "threads/malloc.h"
+#include "threads/slab.h"
 #include "filesys/file.h"
 #include "devices/input.h"
 #include "threads/thread.h"
+#include <sched-stats.h>
+#include <string.h>
+#ifdef VM
+#include "vm/mmap.h"
+#include "vm/page.h"
+#endif
 
 
 typedef int pid_t;
@@ -25,6 +32,8 @@ struct file_descriptor
 
 struct list open_files; // open list
 struct lock fs_lock;    // lock for files
+static struct rwlock open_files_lock; // lookups read open_files, open/close write it
+static struct kmem_cache fd_cache;    // cache of struct file_descriptor
 
 
 
@@ -34,6 +43,8 @@ static void syscall_handler (struct intr_frame *);
 
 // pt 2-2 함수 추가
 bool is_valid_ptr (const void *usr_ptr);
+static bool is_valid_buffer (const void *buffer, unsigned size, bool write);
+static void unpin_buffer (const void *buffer, unsigned size);
 int wait (pid_t pid);
 static void exit (int status);
 pid_t exec (const char *cmd_line);
@@ -52,8 +63,16 @@ unsigned tell (int fd);
 void close (int fd);
 void close_open_file (int fd);
 
+// scheduler statistics
+bool schedstat (pid_t pid, struct sched_stats *stats);
+
+#ifdef VM
+// memory-mapped files
+int mmap (int fd, void *addr);
+void munmap (int mapping);
+#endif
+
 static int allocate_fd(void);
-void close_file_by_owner(tid_t tid);
 
 void
 syscall_init (void) 
@@ -61,6 +80,8 @@ syscall_init (void)
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
   list_init (&open_files);
   lock_init (&fs_lock);
+  rwlock_init (&open_files_lock);
+  kmem_cache_init (&fd_cache, "fd", sizeof (struct file_descriptor), NULL);
 }
 
 static void
@@ -68,6 +89,11 @@ syscall_handler (struct intr_frame *f)
 {
   int *p = f->esp;
 
+#ifdef VM
+  // page faults in the kernel need the user's stack pointer to
+  // tell whether to grow the stack
+  thread_current()->user_esp = f->esp;
+#endif
   if (!is_valid_ptr(p)
   || !is_valid_ptr(p + 1)
   || !is_valid_ptr(p + 2)
@@ -130,6 +156,24 @@ syscall_handler (struct intr_frame *f)
     case SYS_CLOSE:
       close(*(p + 1));
       break;
+
+    case SYS_SCHEDSTAT:
+      f->eax = schedstat(*(p + 1), (struct sched_stats *) *(p + 2));
+      break;
+
+#ifdef VM
+    case SYS_MMAP:
+      f->eax = mmap(*(p + 1), (void *) *(p + 2));
+      break;
+
+    case SYS_MUNMAP:
+      munmap(*(p + 1));
+      break;
+
+    case SYS_FORK:
+      f->eax = process_fork(f);
+      break;
+#endif
     
     default:
       break;
@@ -150,7 +194,76 @@ is_valid_ptr (const void *usr_ptr)
   if(usr_ptr == NULL) return false;
 
   // pt 2-2 user area인지, 범위 내에 있는지 확인
-  return is_user_vaddr(usr_ptr) && pagedir_get_page(cur->pagedir, usr_ptr);
+  if (!is_user_vaddr(usr_ptr)) return false;
+
+#ifdef VM
+  // bring the page in now, rather than faulting on it later
+  // while holding fs_lock
+  return pagedir_get_page(cur->pagedir, usr_ptr) != NULL
+         || page_load(usr_ptr)
+         || page_grow_stack(usr_ptr, cur->user_esp);
+#else
+  return pagedir_get_page(cur->pagedir, usr_ptr) != NULL;
+#endif
+}
+
+#ifdef VM
+// pin the page at USR_PTR, growing the stack into it if need be,
+// and make it writable if WRITE
+static bool
+pin_ptr (const void *usr_ptr, bool write)
+{
+  if (usr_ptr == NULL || !is_user_vaddr(usr_ptr)) return false;
+
+  return page_pin(usr_ptr, write)
+         || (page_grow_stack(usr_ptr, thread_current()->user_esp)
+             && page_pin(usr_ptr, write));
+}
+#endif
+
+// every page of the SIZE bytes at BUFFER must be valid, not only the first.
+// with VM, the pages are also pinned, since the file system copies to and
+// from them holding the disk's lock, where a page fault could deadlock;
+// WRITE says the kernel will write to them.  unpin_buffer() undoes this
+static bool
+is_valid_buffer (const void *buffer, unsigned size, bool write UNUSED)
+{
+  const uint8_t *p = buffer;
+  const uint8_t *end = p + size;
+
+  if (end < p) return false;
+
+#ifdef VM
+  if (!pin_ptr(p, write)) return false;
+
+  for (p = (const uint8_t *) pg_round_down(p) + PGSIZE; p < end; p += PGSIZE)
+    if (!pin_ptr(p, write))
+    {
+      unpin_buffer(buffer, p - (const uint8_t *) buffer);
+      return false;
+    }
+#else
+  if (!is_valid_ptr(p)) return false;
+
+  for (p = (const uint8_t *) pg_round_down(p) + PGSIZE; p < end; p += PGSIZE)
+    if (!is_valid_ptr(p)) return false;
+#endif
+
+  return true;
+}
+
+// unpin the pages that is_valid_buffer() pinned
+static void
+unpin_buffer (const void *buffer UNUSED, unsigned size UNUSED)
+{
+#ifdef VM
+  const uint8_t *p = buffer;
+  const uint8_t *end = p + size;
+
+  page_unpin(p);
+  for (p = (const uint8_t *) pg_round_down(p) + PGSIZE; p < end; p += PGSIZE)
+    page_unpin(p);
+#endif
 }
 
 int 
@@ -270,13 +383,20 @@ open (const char *file_name)
 
   f = filesys_open(file_name);
 
+  if(f != NULL && (fd = kmem_cache_zalloc(&fd_cache)) == NULL)
+  {
+    file_close(f);
+    f = NULL;
+  }
+
   if(f != NULL)
   {
-    fd = calloc(1, sizeof *fd);
     fd->fd_num = allocate_fd();
     fd->owner = thread_current()->tid;
     fd->file_struct = f;
+    rwlock_acquire_write(&open_files_lock);
     list_push_back(&open_files, &fd->elem);
+    rwlock_release_write(&open_files_lock);
     status = fd->fd_num;
   }
 
@@ -314,21 +434,25 @@ get_open_file (int fd)
 {
   struct list_elem *e;
   struct file_descriptor *fd_struct;
+  struct file_descriptor *found = NULL;
+  tid_t tid = thread_current()->tid;
 
+  // a forked child has the same numbers as its parent, so only
+  // the caller's own entries count
+  rwlock_acquire_read(&open_files_lock);
   for (e = list_begin(&open_files); e != list_tail(&open_files); e = list_next(e))
   {
     fd_struct = list_entry(e, struct file_descriptor, elem);
 
-    if (fd_struct->fd_num == fd)
+    if (fd_struct->fd_num == fd && fd_struct->owner == tid)
     {
-      return fd_struct;
+      found = fd_struct;
+      break;
     }
-
-    if(e->next == list_tail(&open_files))
-     break;
   }
+  rwlock_release_read(&open_files_lock);
 
-  return NULL;
+  return found;
 }
 
 int 
@@ -337,8 +461,9 @@ read (int fd, void *buffer, unsigned size)
   
   int status;
   struct file_descriptor *fd_struct;
+  void *user_buffer = buffer;
 
-  if(!is_valid_ptr(buffer)) exit(-1);
+  if(!is_valid_buffer(buffer, size, true)) exit(-1);
 
   lock_acquire(&fs_lock);
 
@@ -364,6 +489,7 @@ read (int fd, void *buffer, unsigned size)
 
   done:
     lock_release(&fs_lock);
+    unpin_buffer(user_buffer, size);
 
   return status;
 }
@@ -374,7 +500,7 @@ write (int fd, const void *buffer, unsigned size)
   int status;
   struct file_descriptor *fd_struct;
 
-  if(!is_valid_ptr(buffer)) exit(-1);
+  if(!is_valid_buffer(buffer, size, false)) exit(-1);
 
   lock_acquire(&fs_lock);
 
@@ -402,6 +528,7 @@ write (int fd, const void *buffer, unsigned size)
 
   done:
     lock_release(&fs_lock);
+    unpin_buffer(buffer, size);
 
   return status;
 }
@@ -455,24 +582,91 @@ close (int fd)
   return;
 }
 
+/* Copies the scheduler statistics, with the counters of thread PID
+   (or of the caller, if PID is -1), into STATS.  Returns false if
+   there is no such thread. */
+bool
+schedstat (pid_t pid, struct sched_stats *stats)
+{
+  struct sched_stats s;
+  struct thread *t;
+  enum intr_level old_level;
+
+  if(!is_valid_ptr(stats) || !is_valid_ptr((uint8_t *) stats + sizeof *stats - 1))
+    exit(-1);
+
+  // keep T from exiting while its counters are copied
+  old_level = intr_disable();
+  t = pid == -1 ? thread_current() : thread_get_by_id(pid);
+  if(t != NULL)
+    thread_get_sched_stats(t, &s);
+  intr_set_level(old_level);
+
+  if(t == NULL)
+    return false;
+
+  memcpy(stats, &s, sizeof s);
+  return true;
+}
+
+#ifdef VM
+/* Maps the file open as FD into memory starting at ADDR.  The
+   mapping has its own copy of the file, so it outlives FD.
+   Returns the new mapping's identifier, or -1 on failure. */
+int
+mmap (int fd, void *addr)
+{
+  struct file_descriptor *fd_struct = get_open_file(fd);
+  struct file *file;
+  int mapping = -1;
+
+  if(fd_struct == NULL)
+    return -1;
+
+  lock_acquire(&fs_lock);
+
+  file = file_reopen(fd_struct->file_struct);
+  if(file != NULL)
+  {
+    mapping = mmap_map(file, addr);
+    if(mapping == -1)
+      file_close(file);
+  }
+
+  lock_release(&fs_lock);
+
+  return mapping;
+}
+
+/* Unmaps MAPPING, writing back the pages the process wrote.
+   Like process_exit(), doesn't take fs_lock (see vm/mmap.c). */
+void
+munmap (int mapping)
+{
+  mmap_unmap(mapping);
+}
+#endif
+
 void 
 close_open_file (int fd)
 {
   struct list_elem *e;
   struct file_descriptor *fd_struct;
 
+  rwlock_acquire_write(&open_files_lock);
   for (e = list_begin(&open_files); e != list_tail(&open_files); e = list_next(e))
   {
     fd_struct = list_entry(e, struct file_descriptor, elem);
 
-    if(fd_struct->fd_num == fd)
+    if(fd_struct->fd_num == fd && fd_struct->owner == thread_current()->tid)
     {
       list_remove(e);
       file_close(fd_struct->file_struct);
-      free(fd_struct);
+      kmem_cache_free(&fd_cache, fd_struct);
       break;
     }
   }
+  rwlock_release_write(&open_files_lock);
 }
 
 int
@@ -489,6 +683,7 @@ close_file_by_owner (tid_t tid)
   struct list_elem *next;
   struct file_descriptor *fd_struct; 
 
+  rwlock_acquire_write (&open_files_lock);
   e = list_begin (&open_files);
   while (e != list_tail (&open_files)) 
     {
@@ -499,11 +694,12 @@ close_file_by_owner (tid_t tid)
 	    {
 	      list_remove (e);
 	      file_close (fd_struct->file_struct);
-          free (fd_struct);
+          kmem_cache_free (&fd_cache, fd_struct);
 	    }
     
       e = next;
     }
+  rwlock_release_write (&open_files_lock);
 }
 
 // void 
@@ -524,3 +720,44 @@ close_file_by_owner (tid_t tid)
 //     }
 //   }
 // }
+
+/* Gives thread TO its own copy of each file that thread FROM
+   has open, under the same descriptor number and at the same
+   position.  Returns false if memory runs out; the copies made
+   so far are still TO's. */
+bool
+copy_files_by_owner (tid_t from, tid_t to)
+{
+  struct list_elem *e;
+  struct file_descriptor *fd_struct;
+  struct file_descriptor *copy;
+  bool success = true;
+
+  lock_acquire(&fs_lock);
+  rwlock_acquire_write(&open_files_lock);
+  for (e = list_begin(&open_files); e != list_tail(&open_files); e = list_next(e))
+  {
+    fd_struct = list_entry(e, struct file_descriptor, elem);
+
+    if (fd_struct->owner != from)
+      continue;
+
+    copy = kmem_cache_zalloc(&fd_cache);
+    if (copy == NULL
+        || (copy->file_struct = file_reopen(fd_struct->file_struct)) == NULL)
+    {
+      if (copy != NULL)
+        kmem_cache_free(&fd_cache, copy);
+      success = false;
+      break;
+    }
+    file_seek(copy->file_struct, file_tell(fd_struct->file_struct));
+    copy->fd_num = fd_struct->fd_num;
+    copy->owner = to;
+    list_push_back(&open_files, &copy->elem);   // after E, skipped as TO's
+  }
+  rwlock_release_write(&open_files_lock);
+  lock_release(&fs_lock);
+
+  return success;
+}
@@ -1,6 +1,11 @@
 #ifndef USERPROG_SYSCALL_H
 #define USERPROG_SYSCALL_H
 
+#include <stdbool.h>
+#include "threads/thread.h"
+
 void syscall_init (void);
+void close_file_by_owner (tid_t);
+bool copy_files_by_owner (tid_t from, tid_t to);
 
 #endif /* userprog/syscall.h */
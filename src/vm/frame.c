@@ -0,0 +1,601 @@
+#include "vm/frame.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "vm/page.h"
+#include "vm/swap.h"
+
+/* Frame table.
+
+   All frames are on one list, in the order the clock hand
+   visits them; new frames go just behind the hand, so they are
+   visited last.  When the user pool is exhausted, frame_alloc()
+   evicts frames chosen by the second-chance (clock) algorithm:
+   the hand passes over a frame whose page has been accessed
+   since its last visit, clearing the accessed bit, and evicts
+   the first one that has not.
+
+   Eviction works on up to EVICT_CLUSTER frames at a time.  The
+   dirty pages and anonymous pages among them are written to a
+   single run of contiguous swap slots, when one is available,
+   except that dirty pages of mapped files are written back to
+   their files.  Clean pages are simply dropped, since they can
+   be read from their file or zero-filled again.  One of the frames goes to
+   the caller and the rest go back to the page allocator, so the
+   next few allocations need not evict at all.
+
+   After fork() (see page.c), a frame may hold the same page of
+   several processes, mapped read-only in each of them, with
+   `ref_cnt' counting them.  The first of them to write to the
+   page gets a copy of its own from frame_unshare(), and the
+   last one left keeps the frame.  The clock evicts such a frame
+   like any other, unmapping it from every process at once: if
+   it has to go to swap, it is written to a single slot, and
+   every page that shared the frame then refers to that slot
+   (see swap.c), so that the processes share it again when each
+   of them loads it back in, each into a frame of its own.
+
+   A read-only page of an executable is the same in every
+   process that runs it, so a frame that holds one is also
+   entered in `text_frames', keyed by the executable's inode and
+   the page's offset and length, and frame_share_text() lets a
+   process that loads the same page map the same frame.  None of
+   the pages in such a frame can have been written, so the clock
+   may evict it even while it is shared, by unmapping it from
+   every process at once, provided that none of them has
+   accessed it since the hand last passed.
+
+   `frame_lock' protects the list, the hand, `text_frames', and
+   each frame's `pages' and `ref_cnt'.  Each page's own
+   lock (see page.h) is held while it is loaded or evicted.  A
+   thread that loads a page takes the page's lock and then
+   `frame_lock', so the clock only tries the locks of the pages
+   it passes, skipping pages that are busy, such as the one
+   whose load caused the eviction, and, once it holds their
+   locks, pages that are pinned (see page_pin()). */
+
+/* Maximum number of frames evicted at once. */
+#define EVICT_CLUSTER 8
+
+static struct list frames;              /* All frames, in clock order. */
+static size_t frame_cnt;                /* Number of frames. */
+static struct list_elem *hand;          /* Next frame the clock visits. */
+static struct hash text_frames;         /* Frames of executables. */
+static struct lock frame_lock;          /* Protects the above. */
+static struct kmem_cache frame_cache;   /* Cache of `struct frame'. */
+
+/* Statistics. */
+static long long evict_passes;          /* # of calls to evict(). */
+static long long evictions;             /* # of frames evicted. */
+static long long clean_drops;           /* # of those not written. */
+static long long write_backs;           /* # written to mapped files. */
+static long long shares;                /* # of pages sharing a frame. */
+static long long cow_copies;            /* # of shared frames copied. */
+static long long text_shares;           /* # of text pages shared. */
+
+static hash_hash_func text_hash;
+static hash_less_func text_less;
+static struct frame *get_frame (enum palloc_flags, bool may_evict);
+static void attach (struct frame *, struct page *);
+static struct frame *evict (void);
+static struct frame *pick_victim (void);
+static bool lock_pages (struct frame *);
+static void unlock_pages (struct frame *, bool evicted);
+static bool is_pinned (struct frame *);
+static bool test_and_clear_accessed (struct frame *);
+static void insert_frame (struct frame *);
+static void remove_frame (struct frame *);
+
+/* Initializes the frame table. */
+void
+frame_init (void)
+{
+  list_init (&frames);
+  hand = list_end (&frames);
+  hash_init (&text_frames, text_hash, text_less, NULL);
+  lock_init (&frame_lock);
+  kmem_cache_init (&frame_cache, "frame", sizeof (struct frame), NULL);
+}
+
+/* Obtains a frame of user memory for PAGE, whose lock must be
+   held, evicting another page if necessary.  If PAL_ZERO is set
+   in FLAGS, the frame is zeroed.  Returns the frame, or a null
+   pointer if no frame can be obtained. */
+struct frame *
+frame_alloc (struct page *page, enum palloc_flags flags)
+{
+  struct frame *f;
+
+  ASSERT (lock_held_by_current_thread (&page->lock));
+
+  f = get_frame (flags, true);
+  if (f != NULL)
+    attach (f, page);
+  return f;
+}
+
+/* Like frame_alloc(), but returns a null pointer instead of
+   evicting a page if the user pool is exhausted. */
+struct frame *
+frame_try_alloc (struct page *page, enum palloc_flags flags)
+{
+  struct frame *f;
+
+  ASSERT (lock_held_by_current_thread (&page->lock));
+
+  f = get_frame (flags, false);
+  if (f != NULL)
+    attach (f, page);
+  return f;
+}
+
+/* Makes F hold PAGE too, in addition to the pages it already
+   holds.  The caller must hold the lock of one of those pages,
+   so that F stays in memory, and must map F read-only for all of
+   them. */
+void
+frame_share (struct frame *f, struct page *page)
+{
+  lock_acquire (&frame_lock);
+  list_push_back (&f->pages, &page->frame_elem);
+  f->ref_cnt++;
+  lock_release (&frame_lock);
+  shares++;
+}
+
+/* Looks for a frame that holds the READ_BYTES bytes at offset
+   OFS in executable INODE, followed by zeros, as a read-only
+   page.  If there is one, makes it hold PAGE, whose lock must be
+   held, too, and returns it; the caller must map it read-only.
+   Otherwise, returns a null pointer. */
+struct frame *
+frame_share_text (struct page *page, struct inode *inode, off_t ofs,
+                  size_t read_bytes)
+{
+  struct frame key;
+  struct hash_elem *e;
+  struct frame *f = NULL;
+
+  ASSERT (lock_held_by_current_thread (&page->lock));
+
+  key.inode = inode;
+  key.ofs = ofs;
+  key.read_bytes = read_bytes;
+
+  lock_acquire (&frame_lock);
+  e = hash_find (&text_frames, &key.text_elem);
+  if (e != NULL)
+    {
+      f = hash_entry (e, struct frame, text_elem);
+      list_push_back (&f->pages, &page->frame_elem);
+      f->ref_cnt++;
+      text_shares++;
+    }
+  lock_release (&frame_lock);
+  return f;
+}
+
+/* Records that F, just loaded for a page whose lock is held,
+   holds the READ_BYTES bytes at offset OFS in executable INODE,
+   followed by zeros, and is mapped read-only, so that other
+   processes that run INODE may share it.  If another frame
+   already holds the same page, F stays private. */
+void
+frame_set_text (struct frame *f, struct inode *inode, off_t ofs,
+                size_t read_bytes)
+{
+  f->inode = inode;
+  f->ofs = ofs;
+  f->read_bytes = read_bytes;
+
+  lock_acquire (&frame_lock);
+  if (hash_insert (&text_frames, &f->text_elem) != NULL)
+    f->inode = NULL;
+  lock_release (&frame_lock);
+}
+
+/* Returns a frame that holds the contents of F, which holds
+   PAGE, for PAGE alone, so that PAGE's process may write to it.
+   That is F itself if it holds no other page, or else a copy of
+   F, in which case PAGE no longer holds F.  PAGE's lock must be
+   held.  Returns a null pointer if no frame can be obtained for
+   the copy. */
+struct frame *
+frame_unshare (struct frame *f, struct page *page)
+{
+  struct frame *copy;
+  bool shared;
+
+  ASSERT (lock_held_by_current_thread (&page->lock));
+
+  lock_acquire (&frame_lock);
+  shared = f->ref_cnt > 1;
+  lock_release (&frame_lock);
+  if (!shared)
+    return f;
+
+  /* No process writes to F while PAGE still holds it, and F
+     cannot be evicted while PAGE's lock is held, even if the
+     other pages let go of it meanwhile. */
+  copy = get_frame (0, true);
+  if (copy == NULL)
+    return NULL;
+  memcpy (copy->kpage, f->kpage, PGSIZE);
+  frame_free (f, page);
+  attach (copy, page);
+  cow_copies++;
+  return copy;
+}
+
+/* Drops PAGE, whose lock must be held, from the pages that F
+   holds.  If it was the last one, removes F from the frame table
+   and frees it and its page of memory. */
+void
+frame_free (struct frame *f, struct page *page)
+{
+  bool last;
+
+  ASSERT (lock_held_by_current_thread (&page->lock));
+
+  lock_acquire (&frame_lock);
+  list_remove (&page->frame_elem);
+  last = --f->ref_cnt == 0;
+  if (last)
+    remove_frame (f);
+  lock_release (&frame_lock);
+
+  if (last)
+    {
+      palloc_free_page (f->kpage);
+      kmem_cache_free (&frame_cache, f);
+    }
+}
+
+/* Prints frame table statistics. */
+void
+frame_print_stats (void)
+{
+  printf ("Frame: %zu frames, %lld evicted in %lld passes "
+          "(%lld clean, %lld written back to mapped files), "
+          "%lld pages shared by fork, %lld copied on write, "
+          "%lld text pages shared\n",
+          frame_cnt, evictions, evict_passes, clean_drops, write_backs,
+          shares, cow_copies, text_shares);
+}
+
+/* Obtains a frame of user memory, not yet in the frame table,
+   evicting other pages if necessary and MAY_EVICT is true.  If
+   PAL_ZERO is set in FLAGS, the frame is zeroed.  Returns a null
+   pointer if no frame can be obtained. */
+static struct frame *
+get_frame (enum palloc_flags flags, bool may_evict)
+{
+  struct frame *f;
+  void *kpage;
+
+  /* Evicting a user page is cheaper than having the kernel's
+     caches shrink on every page fault, so only ask them once
+     nothing can be evicted. */
+  kpage = palloc_get_page (PAL_USER | PAL_NORECLAIM | flags);
+  if (kpage == NULL && may_evict)
+    {
+      f = evict ();
+      if (f != NULL)
+        {
+          if (flags & PAL_ZERO)
+            memset (f->kpage, 0, PGSIZE);
+          return f;
+        }
+      kpage = palloc_get_page (PAL_USER | flags);
+    }
+  if (kpage == NULL)
+    return NULL;
+
+  f = kmem_cache_alloc (&frame_cache);
+  if (f == NULL)
+    {
+      palloc_free_page (kpage);
+      return NULL;
+    }
+  f->kpage = kpage;
+  return f;
+}
+
+/* Makes F hold PAGE alone and adds it to the frame table. */
+static void
+attach (struct frame *f, struct page *page)
+{
+  list_init (&f->pages);
+  list_push_back (&f->pages, &page->frame_elem);
+  f->ref_cnt = 1;
+  f->inode = NULL;
+
+  lock_acquire (&frame_lock);
+  insert_frame (f);
+  lock_release (&frame_lock);
+}
+
+/* Evicts up to EVICT_CLUSTER frames, as described at the top of
+   this file, and returns one of them, no longer in the frame
+   table.  Returns a null pointer if no frame can be evicted. */
+static struct frame *
+evict (void)
+{
+  struct frame *victims[EVICT_CLUSTER];
+  bool to_swap[EVICT_CLUSTER];
+  struct frame *kept = NULL;
+  size_t cnt = 0;
+  size_t swap_cnt = 0;
+  size_t slot;
+  size_t i;
+
+  lock_acquire (&frame_lock);
+  while (cnt < EVICT_CLUSTER && (victims[cnt] = pick_victim ()) != NULL)
+    cnt++;
+  lock_release (&frame_lock);
+  evict_passes++;
+
+  /* Unmap each victim before looking at its dirty bits, so that
+     its processes cannot change them behind our back.  If a
+     process touches it now, it faults and waits for the page's
+     lock.  A victim with more than one page holds text or pages
+     shared by fork(), which are never of mapped files, so it
+     goes to swap if any of its pages has to. */
+  for (i = 0; i < cnt; i++)
+    {
+      struct frame *f = victims[i];
+      struct page *p = NULL;
+      struct list_elem *e;
+      bool dirty = false;
+      bool anon = false;
+
+      for (e = list_begin (&f->pages); e != list_end (&f->pages);
+           e = list_next (e))
+        {
+          p = list_entry (e, struct page, frame_elem);
+          pagedir_clear_page (p->pagedir, p->upage);
+          dirty = dirty || pagedir_is_dirty (p->pagedir, p->upage);
+          anon = anon || p->type == PAGE_ANON;
+        }
+      to_swap[i] = anon || (dirty && p->type != PAGE_MMAP);
+      if (to_swap[i])
+        swap_cnt++;
+      else if (dirty)
+        {
+          file_write_at (p->file, victims[i]->kpage, p->read_bytes, p->ofs);
+          write_backs++;
+        }
+      else
+        clean_drops++;
+    }
+
+  /* Write the pages that exist nowhere else to swap, in one run
+     of contiguous slots if there is one, else slot by slot. */
+  slot = swap_cnt > 0 ? swap_alloc (swap_cnt) : SWAP_ERROR;
+  for (i = 0; i < cnt; i++)
+    {
+      struct frame *f = victims[i];
+
+      if (to_swap[i])
+        {
+          size_t s = slot != SWAP_ERROR ? slot++ : swap_alloc (1);
+          struct list_elem *e;
+
+          if (s == SWAP_ERROR)
+            {
+              /* Out of swap.  Map the pages again, read-only if
+                 they are still shared. */
+              for (e = list_begin (&f->pages); e != list_end (&f->pages);
+                   e = list_next (e))
+                {
+                  struct page *p = list_entry (e, struct page, frame_elem);
+
+                  pagedir_set_page (p->pagedir, p->upage, f->kpage,
+                                    p->writable && f->ref_cnt == 1);
+                  pagedir_set_dirty (p->pagedir, p->upage, true);
+                }
+              lock_acquire (&frame_lock);
+              insert_frame (f);
+              lock_release (&frame_lock);
+              unlock_pages (f, false);
+              continue;
+            }
+          swap_write (s, f->kpage);
+          for (e = list_begin (&f->pages); e != list_end (&f->pages);
+               e = list_next (e))
+            {
+              struct page *p = list_entry (e, struct page, frame_elem);
+
+              if (e != list_begin (&f->pages))
+                swap_share (s);
+              p->type = PAGE_ANON;
+              p->swap_slot = s;
+            }
+        }
+
+      unlock_pages (f, true);
+      evictions++;
+
+      if (kept == NULL)
+        kept = f;
+      else
+        {
+          palloc_free_page (f->kpage);
+          kmem_cache_free (&frame_cache, f);
+        }
+    }
+  return kept;
+}
+
+/* Advances the clock hand until it finds a frame to evict,
+   which it removes from the frame table and returns with the
+   locks of its pages held.  Returns a null pointer if every
+   frame is busy or pinned.  `frame_lock' must be held. */
+static struct frame *
+pick_victim (void)
+{
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+
+  /* Two trips around the clock clear every accessed bit on the
+     way, so they find a victim unless all pages are busy or
+     pinned. */
+  for (i = 0; i < 2 * frame_cnt; i++)
+    {
+      struct frame *f;
+
+      if (hand == list_end (&frames))
+        hand = list_begin (&frames);
+      f = list_entry (hand, struct frame, elem);
+      hand = list_next (hand);
+
+      if (!lock_pages (f))
+        continue;
+      if (is_pinned (f) || test_and_clear_accessed (f))
+        {
+          unlock_pages (f, false);
+          continue;
+        }
+      remove_frame (f);
+      return f;
+    }
+  return NULL;
+}
+
+/* Tries to acquire the locks of all of the pages that F holds,
+   without waiting.  Returns true if successful, or false,
+   holding none of them, if any of them is busy. */
+static bool
+lock_pages (struct frame *f)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    if (!lock_try_acquire (&list_entry (e, struct page, frame_elem)->lock))
+      {
+        while (e != list_begin (&f->pages))
+          {
+            e = list_prev (e);
+            lock_release (&list_entry (e, struct page, frame_elem)->lock);
+          }
+        return false;
+      }
+  return true;
+}
+
+/* Releases the locks of all of the pages that F holds.  If
+   EVICTED is true, F has been evicted, so first records that
+   they are no longer in memory. */
+static void
+unlock_pages (struct frame *f, bool evicted)
+{
+  struct list_elem *e = list_begin (&f->pages);
+
+  /* Once a page's lock is released, the page may be loaded
+     again, into another frame, so step past it first. */
+  while (e != list_end (&f->pages))
+    {
+      struct page *p = list_entry (e, struct page, frame_elem);
+
+      e = list_next (e);
+      if (evicted)
+        p->frame = NULL;
+      lock_release (&p->lock);
+    }
+}
+
+/* Returns true if any of the pages that F holds is pinned.
+   The pages' locks must be held. */
+static bool
+is_pinned (struct frame *f)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    if (list_entry (e, struct page, frame_elem)->pin_cnt > 0)
+      return true;
+  return false;
+}
+
+/* Returns true if any of the pages that F holds has been
+   accessed since the last call, clearing their accessed bits.
+   The pages' locks must be held. */
+static bool
+test_and_clear_accessed (struct frame *f)
+{
+  struct list_elem *e;
+  bool accessed = false;
+
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    {
+      struct page *p = list_entry (e, struct page, frame_elem);
+
+      if (pagedir_is_accessed (p->pagedir, p->upage))
+        {
+          pagedir_set_accessed (p->pagedir, p->upage, false);
+          accessed = true;
+        }
+    }
+  return accessed;
+}
+
+/* Adds F to the frame table just behind the clock hand.
+   `frame_lock' must be held. */
+static void
+insert_frame (struct frame *f)
+{
+  list_insert (hand, &f->elem);
+  frame_cnt++;
+}
+
+/* Removes F from the frame table.  `frame_lock' must be
+   held. */
+static void
+remove_frame (struct frame *f)
+{
+  if (hand == &f->elem)
+    hand = list_next (hand);
+  list_remove (&f->elem);
+  frame_cnt--;
+
+  if (f->inode != NULL)
+    {
+      hash_delete (&text_frames, &f->text_elem);
+      f->inode = NULL;
+    }
+}
+
+/* Returns a hash value for the frame of text that E refers
+   to. */
+static unsigned
+text_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct frame *f = hash_entry (e, struct frame, text_elem);
+  return hash_int ((uintptr_t) f->inode ^ f->ofs);
+}
+
+/* Returns true if the frame of text that A refers to precedes
+   the one that B refers to. */
+static bool
+text_less (const struct hash_elem *a, const struct hash_elem *b,
+           void *aux UNUSED)
+{
+  const struct frame *fa = hash_entry (a, struct frame, text_elem);
+  const struct frame *fb = hash_entry (b, struct frame, text_elem);
+
+  if (fa->inode != fb->inode)
+    return fa->inode < fb->inode;
+  else if (fa->ofs != fb->ofs)
+    return fa->ofs < fb->ofs;
+  else
+    return fa->read_bytes < fb->read_bytes;
+}
@@ -0,0 +1,48 @@
+#ifndef VM_FRAME_H
+#define VM_FRAME_H
+
+#include <hash.h>
+#include <list.h>
+#include "filesys/off_t.h"
+#include "threads/palloc.h"
+
+struct inode;
+struct page;
+
+/* Frame table.
+
+   Every page of user memory that holds a page of a process's
+   supplemental page table has an entry here, so that it can be
+   evicted when the user pool runs out.  After fork(), or when
+   several processes run the same executable, a frame may hold a
+   page of several processes at once.  See frame.c for
+   details. */
+
+/* A frame. */
+struct frame
+  {
+    void *kpage;                /* Kernel virtual address. */
+    struct list pages;          /* Pages it holds. */
+    unsigned ref_cnt;           /* Number of pages in `pages'. */
+    struct list_elem elem;      /* Element in frame table. */
+
+    /* Read-only page of an executable, or null `inode'. */
+    struct inode *inode;        /* Executable. */
+    off_t ofs;                  /* Offset in executable. */
+    size_t read_bytes;          /* Bytes read; the rest is zeroed. */
+    struct hash_elem text_elem; /* Element in text frame table. */
+  };
+
+void frame_init (void);
+struct frame *frame_alloc (struct page *, enum palloc_flags);
+struct frame *frame_try_alloc (struct page *, enum palloc_flags);
+void frame_share (struct frame *, struct page *);
+struct frame *frame_share_text (struct page *, struct inode *, off_t ofs,
+                                size_t read_bytes);
+void frame_set_text (struct frame *, struct inode *, off_t ofs,
+                     size_t read_bytes);
+struct frame *frame_unshare (struct frame *, struct page *);
+void frame_free (struct frame *, struct page *);
+void frame_print_stats (void);
+
+#endif /* vm/frame.h */
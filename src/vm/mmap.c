@@ -0,0 +1,199 @@
+#include "vm/mmap.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "vm/page.h"
+
+/* Memory-mapped files.
+
+   A mapping puts each page of a file at consecutive pages of a
+   process's address space as a PAGE_MMAP page of its
+   supplemental page table, so that the file is read page by
+   page as the process touches it, and each page that the
+   process writes is written back to the file when it is evicted
+   or unmapped.  The tail of the last page, past the end of the
+   file, reads as zeros and is never written back.
+
+   Each mapping has its own reopened copy of the file, so closing
+   or removing the file does not affect it.  A child created by
+   fork() gets its own copy of each of its parent's mappings,
+   with the same identifier, through mmap_copy().
+
+   Unmapping writes pages back and closes the file without
+   taking `fs_lock', whether the process calls munmap() or exits
+   with the mapping in place, just as the pages themselves are
+   read and written back without it (see page.c).  Only mmap()
+   takes it, around reopening the file. */
+
+/* A mapping. */
+struct mapping
+  {
+    int id;                     /* Mapping identifier. */
+    struct file *file;          /* File mapped. */
+    uint8_t *addr;              /* First page. */
+    size_t page_cnt;            /* Number of pages. */
+    struct list_elem elem;      /* Element in thread's `mappings'. */
+  };
+
+static struct mapping *find_mapping (int id);
+static bool add_pages (struct mapping *);
+static void unmap (struct mapping *);
+
+/* Maps FILE into the current process's address space starting
+   at ADDR, and returns a new mapping identifier.  Returns -1,
+   without taking over FILE, if FILE is empty, ADDR is null or
+   not page-aligned, or any page in the range is already in use
+   or not in user space.  Otherwise, the mapping takes over FILE,
+   which should be a file opened just for it, and closes it on
+   unmapping. */
+int
+mmap_map (struct file *file, void *addr)
+{
+  struct thread *t = thread_current ();
+  struct mapping *m;
+  off_t length = file_length (file);
+
+  if (length == 0 || addr == NULL || pg_ofs (addr) != 0)
+    return -1;
+
+  m = malloc (sizeof *m);
+  if (m == NULL)
+    return -1;
+  m->file = file;
+  m->addr = addr;
+  m->page_cnt = DIV_ROUND_UP (length, PGSIZE);
+  if (!add_pages (m))
+    {
+      free (m);
+      return -1;
+    }
+
+  m->id = t->next_mapping++;
+  list_push_back (&t->mappings, &m->elem);
+  return m->id;
+}
+
+/* Gives the current process, which is being created by fork(),
+   a copy of each of PARENT's mappings, mapping a new copy of
+   the same file at the same address.  PARENT must not be
+   running, and must have written back the pages it wrote (see
+   page_table_copy()).  Returns true if successful, false if
+   memory is not available. */
+bool
+mmap_copy (struct thread *parent)
+{
+  struct thread *t = thread_current ();
+  struct list_elem *e;
+
+  for (e = list_begin (&parent->mappings); e != list_end (&parent->mappings);
+       e = list_next (e))
+    {
+      struct mapping *pm = list_entry (e, struct mapping, elem);
+      struct mapping *m = malloc (sizeof *m);
+
+      if (m == NULL)
+        return false;
+      m->file = file_reopen (pm->file);
+      m->addr = pm->addr;
+      m->page_cnt = pm->page_cnt;
+      if (m->file == NULL || !add_pages (m))
+        {
+          file_close (m->file);
+          free (m);
+          return false;
+        }
+      m->id = pm->id;
+      list_push_back (&t->mappings, &m->elem);
+    }
+  t->next_mapping = parent->next_mapping;
+  return true;
+}
+
+/* Unmaps the current process's mapping MAPPING, if it has one,
+   writing back each page that has been written. */
+void
+mmap_unmap (int mapping)
+{
+  struct mapping *m = find_mapping (mapping);
+
+  if (m != NULL)
+    unmap (m);
+}
+
+/* Unmaps all of the current process's mappings.  Called when it
+   exits. */
+void
+mmap_unmap_all (void)
+{
+  struct list *mappings = &thread_current ()->mappings;
+
+  while (!list_empty (mappings))
+    unmap (list_entry (list_front (mappings), struct mapping, elem));
+}
+
+/* Returns the current process's mapping with identifier ID, or
+   a null pointer if there is none. */
+static struct mapping *
+find_mapping (int id)
+{
+  struct list *mappings = &thread_current ()->mappings;
+  struct list_elem *e;
+
+  for (e = list_begin (mappings); e != list_end (mappings); e = list_next (e))
+    {
+      struct mapping *m = list_entry (e, struct mapping, elem);
+      if (m->id == id)
+        return m;
+    }
+  return NULL;
+}
+
+/* Adds the pages of M to the current process's supplemental
+   page table.  Returns true if successful, or false, without
+   adding any, if any page is already in use or not in user
+   space, or memory is not available. */
+static bool
+add_pages (struct mapping *m)
+{
+  uint32_t *pd = thread_current ()->pagedir;
+  off_t length = file_length (m->file);
+  size_t i;
+
+  for (i = 0; i < m->page_cnt; i++)
+    {
+      uint8_t *upage = m->addr + i * PGSIZE;
+      off_t ofs = i * PGSIZE;
+      size_t read_bytes = length - ofs < PGSIZE ? length - ofs : PGSIZE;
+
+      if (!is_user_vaddr (upage) || upage < m->addr
+          || pagedir_get_page (pd, upage) != NULL
+          || !page_add_mmap (upage, m->file, ofs, read_bytes))
+        {
+          while (i-- > 0)
+            page_remove (m->addr + i * PGSIZE);
+          return false;
+        }
+    }
+  return true;
+}
+
+/* Removes the pages of M, closes its file and frees it.  The
+   pages are unmapped all at once first, so that the TLB is
+   brought up to date once rather than page by page. */
+static void
+unmap (struct mapping *m)
+{
+  size_t i;
+
+  pagedir_clear_range (thread_current ()->pagedir, m->addr, m->page_cnt);
+  for (i = 0; i < m->page_cnt; i++)
+    page_remove (m->addr + i * PGSIZE);
+  list_remove (&m->elem);
+  file_close (m->file);
+  free (m);
+}
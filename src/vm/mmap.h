@@ -0,0 +1,16 @@
+#ifndef VM_MMAP_H
+#define VM_MMAP_H
+
+#include <stdbool.h>
+
+struct file;
+struct thread;
+
+/* Memory-mapped files. */
+
+int mmap_map (struct file *, void *addr);
+void mmap_unmap (int mapping);
+void mmap_unmap_all (void);
+bool mmap_copy (struct thread *parent);
+
+#endif /* vm/mmap.h */
@@ -0,0 +1,710 @@
+#include "vm/page.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "threads/palloc.h"
+#include "threads/slab.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "vm/frame.h"
+#include "vm/swap.h"
+
+/* Supplemental page table.
+
+   load() does not read a process's executable into memory.  It
+   only records each page of each segment here, as a PAGE_FILE
+   page for the part backed by the file and a PAGE_ZERO page for
+   the rest, and the page fault handler calls page_load() to
+   bring in a page the first time the process touches it.  Pages
+   that are never touched, such as code for features a run does
+   not use, are never read at all.
+
+   A loaded page may later be evicted to make room for another
+   (see frame.c).  A clean page is simply dropped and loaded
+   again the same way next time.  A page that has been written
+   becomes a PAGE_ANON page, whose contents are kept in a swap
+   slot until it is loaded again.
+
+   The read-only PAGE_FILE pages of an executable, that is, its
+   code and constant data, are the same in every process that
+   runs it, so a process that loads one that another process
+   already has in memory maps the same frame instead of reading
+   it again (see frame.c).
+
+   PAGE_MMAP pages belong to memory-mapped files (see mmap.c).
+   They are loaded like PAGE_FILE pages, but when one that has
+   been written is evicted or removed, it is written back to its
+   file instead of to swap.
+
+   fork() gives the child a copy of its parent's table through
+   page_table_copy().  Each page that the parent has in memory
+   is then held by the same frame for both processes, mapped
+   read-only in both (see frame.c), and when either process
+   writes to it, page_unshare() gives that process a copy of its
+   own.  A page that the parent had written becomes a PAGE_ANON
+   page in both, since its file no longer has its contents, and
+   a page that the parent has in swap stays in the same swap
+   slot for both.
+
+   When a process faults in pages at increasing addresses, as
+   it does when it scans an array or a mapped file, each fault
+   also maps a window of the pages that follow, so that the next
+   several accesses do not fault at all.  Each process tracks up
+   to FAULT_STREAMS such runs of faults at once.  A fault on the
+   first page past a run's window continues the run and doubles
+   its window, up to FAULT_WINDOW_MAX pages; a fault inside the
+   window, on a page that was mapped ahead but evicted before it
+   was used, continues the run but halves the window; and any
+   other fault starts a new run in place of the oldest, with no
+   window yet, so that random access never maps pages ahead.
+   Pages are only mapped ahead while there is free memory for
+   them, without evicting other pages, and pages in swap are
+   left alone.
+
+   A process starts out with a single page of stack.  An access
+   to an address that is not in its table, but lies below
+   PHYS_BASE within `page_stack_limit' pages and no more than 32
+   bytes below the process's stack pointer, the most that the
+   PUSHA instruction touches before it moves the stack pointer,
+   adds a PAGE_ZERO page there (see page_grow_stack()).  Stack
+   pages are evicted to swap like any other page.
+
+   A system call that has the file system copy data to or from a
+   user buffer first pins each page of the buffer with
+   page_pin(), which brings it into memory, and, if the kernel is
+   to write to it, gives the process a writable copy of its own.
+   The eviction code passes over pinned pages, so the copy never
+   faults, which it must not do: it runs with the disk's lock
+   held, and loading or evicting a page may need the same disk.
+
+   The table is a hash table keyed by user page.  Only its
+   process adds pages to it or looks them up, so it needs no
+   lock, but the eviction code reaches pages through the frame
+   table, so each page has a lock that is held while the page is
+   loaded, evicted or freed.  Pages are read from and written
+   back to their files with file_read_at() and file_write_at(),
+   without taking any lock, as load() itself does.  The process
+   keeps its executable open, and denies writes to it, until it
+   exits, and each mapping keeps its own file open. */
+
+/* Maximum number of pages in a process's stack. */
+size_t page_stack_limit = STACK_LIMIT_DEFAULT;
+
+/* Cache of `struct page'. */
+static struct kmem_cache page_cache;
+
+/* Statistics. */
+static long long file_loads;    /* # of pages read from files. */
+static long long zero_loads;    /* # of pages zero-filled. */
+static long long swap_loads;    /* # of pages read from swap. */
+static long long major_faults;  /* Sum of exited processes' counters. */
+static long long minor_faults;
+static long long around_pages;
+
+static hash_hash_func page_hash;
+static hash_less_func page_less;
+static hash_action_func page_free;
+static struct page *new_page (void *upage, enum page_type, bool writable);
+static bool load (struct page *, bool around);
+static void fault_around (uint8_t *upage);
+static size_t map_ahead (uint8_t *upage, size_t page_cnt);
+static bool copy (struct page *);
+static bool unshare (struct page *);
+static void release (struct page *);
+
+/* Initializes the supplemental page table module. */
+void
+page_init (void)
+{
+  kmem_cache_init (&page_cache, "page", sizeof (struct page), NULL);
+}
+
+/* Initializes PAGES as an empty supplemental page table.
+   Returns true if successful, false on failure. */
+bool
+page_table_create (struct hash *pages)
+{
+  return hash_init (pages, page_hash, page_less, NULL);
+}
+
+/* Frees every page in PAGES, the current process's table,
+   along with its frame or swap slot, and PAGES itself, and adds
+   the process's fault counters to the totals.  Must be called
+   before the process's page directory is destroyed, but after it
+   is deactivated, so that unmapping the pages one by one costs
+   no TLB updates. */
+void
+page_table_destroy (struct hash *pages)
+{
+  struct thread *t = thread_current ();
+
+  ASSERT (pages == &t->pages);
+
+  hash_destroy (pages, page_free);
+  major_faults += t->faults.major;
+  minor_faults += t->faults.minor;
+  around_pages += t->faults.around;
+}
+
+/* Copies the pages of PARENT, which must not be running, into
+   the current process's table, which must be empty.  PAGE_FILE
+   pages are read from the current process's `exec_file' instead
+   of PARENT's.  Pages of mapped files are not copied, since
+   mmap_copy() maps the files again, but those that PARENT has
+   written are written back first.  Returns true if successful,
+   false if memory is not available. */
+bool
+page_table_copy (struct thread *parent)
+{
+  struct hash_iterator i;
+
+  hash_first (&i, &parent->pages);
+  while (hash_next (&i))
+    {
+      struct page *p = hash_entry (hash_cur (&i), struct page, elem);
+      bool success;
+
+      lock_acquire (&p->lock);
+      success = copy (p);
+      lock_release (&p->lock);
+      if (!success)
+        return false;
+    }
+  return true;
+}
+
+/* Records that UPAGE in the current process is to hold
+   READ_BYTES bytes read from FILE starting at offset OFS,
+   followed by zeros up to the end of the page.  The process may
+   write to the page if WRITABLE is true.  Returns true if
+   successful, false if UPAGE is already in use or memory is not
+   available. */
+bool
+page_add_file (void *upage, struct file *file, off_t ofs,
+               size_t read_bytes, bool writable)
+{
+  struct page *p;
+
+  ASSERT (read_bytes <= PGSIZE);
+
+  if (read_bytes == 0)
+    return page_add_zero (upage, writable);
+
+  p = new_page (upage, PAGE_FILE, writable);
+  if (p == NULL)
+    return false;
+  p->file = file;
+  p->ofs = ofs;
+  p->read_bytes = read_bytes;
+  return true;
+}
+
+/* Records that UPAGE in the current process is mapped to
+   READ_BYTES bytes of FILE starting at offset OFS, followed by
+   zeros up to the end of the page.  The page is writable, and
+   what the process writes to the first READ_BYTES bytes goes
+   back to FILE.  Returns true if successful, false if UPAGE is
+   already in use or memory is not available. */
+bool
+page_add_mmap (void *upage, struct file *file, off_t ofs, size_t read_bytes)
+{
+  struct page *p;
+
+  ASSERT (read_bytes > 0 && read_bytes <= PGSIZE);
+
+  p = new_page (upage, PAGE_MMAP, true);
+  if (p == NULL)
+    return false;
+  p->file = file;
+  p->ofs = ofs;
+  p->read_bytes = read_bytes;
+  return true;
+}
+
+/* Removes UPAGE from the current process's address space,
+   writing it back to its file first if it is a PAGE_MMAP page
+   that has been written.  UPAGE need not be in the table. */
+void
+page_remove (void *upage)
+{
+  struct page *p = page_lookup (upage);
+
+  if (p != NULL)
+    {
+      hash_delete (&thread_current ()->pages, &p->elem);
+      release (p);
+    }
+}
+
+/* Records that UPAGE in the current process is to hold all
+   zeros.  The process may write to the page if WRITABLE is
+   true.  Returns true if successful, false if UPAGE is already
+   in use or memory is not available. */
+bool
+page_add_zero (void *upage, bool writable)
+{
+  return new_page (upage, PAGE_ZERO, writable) != NULL;
+}
+
+/* Returns the page containing user virtual address UADDR in the
+   current process, or a null pointer if there is none. */
+struct page *
+page_lookup (const void *uaddr)
+{
+  struct thread *t = thread_current ();
+  struct page p;
+  struct hash_elem *e;
+
+  if (t->pagedir == NULL || !is_user_vaddr (uaddr))
+    return NULL;
+
+  p.upage = pg_round_down (uaddr);
+  e = hash_find (&t->pages, &p.elem);
+  return e != NULL ? hash_entry (e, struct page, elem) : NULL;
+}
+
+/* Brings the page containing user virtual address UADDR in the
+   current process into memory, if it is not there already.
+   Returns true if the page is in memory, false if UADDR is not
+   part of the process's address space or the page cannot be
+   loaded. */
+bool
+page_load (const void *uaddr)
+{
+  struct page *p = page_lookup (uaddr);
+  bool success;
+
+  if (p == NULL)
+    return false;
+
+  lock_acquire (&p->lock);
+  success = p->frame != NULL || load (p, false);
+  lock_release (&p->lock);
+  return success;
+}
+
+/* Brings the page containing user virtual address UADDR, at
+   which the current process faulted, into memory, as
+   page_load() does, and then maps pages ahead of it if the
+   process seems to be faulting its way through memory in
+   order.  Returns true if the page is in memory, false if UADDR
+   is not part of the process's address space or the page cannot
+   be loaded. */
+bool
+page_fault_load (const void *uaddr)
+{
+  struct page *p = page_lookup (uaddr);
+  bool success;
+
+  if (p == NULL)
+    return false;
+
+  lock_acquire (&p->lock);
+  if (p->frame != NULL)
+    {
+      /* Loaded by another thread, or by fault-around, since the
+         fault. */
+      thread_current ()->faults.minor++;
+      success = true;
+    }
+  else
+    success = load (p, false);
+  lock_release (&p->lock);
+
+  if (success)
+    fault_around (p->upage);
+  return success;
+}
+
+/* Adds the page containing user virtual address UADDR to the
+   current process's stack, and brings it into memory, if UADDR
+   is within the stack limit below PHYS_BASE and no more than 32
+   bytes below ESP, the process's stack pointer.  Returns true if
+   successful, false if UADDR does not look like part of the
+   stack, is already in use, or memory is not available. */
+bool
+page_grow_stack (const void *uaddr, const void *esp)
+{
+  uint8_t *upage = pg_round_down (uaddr);
+
+  if (!is_user_vaddr (uaddr)
+      || (uintptr_t) uaddr + 32 < (uintptr_t) esp
+      || upage < (uint8_t *) PHYS_BASE - page_stack_limit * PGSIZE)
+    return false;
+
+  return page_add_zero (upage, true) && page_load (upage);
+}
+
+/* Gives the current process a copy of its own of the page
+   containing user virtual address UADDR, which it shares with
+   another process, and makes it writable.  Returns true if
+   successful, false if UADDR is not in a writable page of the
+   process's address space or memory is not available. */
+bool
+page_unshare (const void *uaddr)
+{
+  struct page *p = page_lookup (uaddr);
+  bool success;
+
+  if (p == NULL || !p->writable)
+    return false;
+
+  lock_acquire (&p->lock);
+  if (p->frame == NULL)
+    success = load (p, false);
+  else
+    {
+      thread_current ()->faults.minor++;
+      success = unshare (p);
+    }
+  lock_release (&p->lock);
+  return success;
+}
+
+/* Brings the page containing user virtual address UADDR in the
+   current process into memory, if it is not there already, and
+   pins it there until page_unpin() is called for it as many
+   times as this function.  If WRITE is true, the kernel is about
+   to write to the page, so it is also made writable, with a copy
+   of its own if it is shared with another process.  Returns true
+   if successful, false if UADDR is not part of the process's
+   address space, WRITE is true and the page is read-only, or the
+   page cannot be loaded. */
+bool
+page_pin (const void *uaddr, bool write)
+{
+  struct page *p = page_lookup (uaddr);
+  bool success;
+
+  if (p == NULL || (write && !p->writable))
+    return false;
+
+  lock_acquire (&p->lock);
+  if (p->frame == NULL)
+    success = load (p, false);
+  else
+    success = !write || unshare (p);
+  if (success)
+    p->pin_cnt++;
+  lock_release (&p->lock);
+  return success;
+}
+
+/* Unpins the page containing user virtual address UADDR in the
+   current process, which page_pin() pinned. */
+void
+page_unpin (const void *uaddr)
+{
+  struct page *p = page_lookup (uaddr);
+
+  ASSERT (p != NULL);
+
+  lock_acquire (&p->lock);
+  ASSERT (p->pin_cnt > 0);
+  p->pin_cnt--;
+  lock_release (&p->lock);
+}
+
+/* Prints demand paging statistics. */
+void
+page_print_stats (void)
+{
+  printf ("Page: %lld pages read from files, %lld zero-filled, "
+          "%lld read from swap\n",
+          file_loads, zero_loads, swap_loads);
+  printf ("Page: %lld major faults, %lld minor faults, "
+          "%lld pages mapped ahead\n",
+          major_faults, minor_faults, around_pages);
+}
+
+/* Adds a page of TYPE at UPAGE to the current process's
+   supplemental page table and returns it, or returns a null
+   pointer if UPAGE is already in the table or memory is not
+   available. */
+static struct page *
+new_page (void *upage, enum page_type type, bool writable)
+{
+  struct page *p = kmem_cache_zalloc (&page_cache);
+
+  if (p == NULL)
+    return NULL;
+  p->upage = upage;
+  p->pagedir = thread_current ()->pagedir;
+  p->type = type;
+  p->writable = writable;
+  lock_init (&p->lock);
+  p->swap_slot = SWAP_ERROR;
+
+  if (hash_insert (&thread_current ()->pages, &p->elem) != NULL)
+    {
+      kmem_cache_free (&page_cache, p);
+      return NULL;
+    }
+  return p;
+}
+
+/* Loads P, which is not in memory, into a new frame and maps
+   it, counting a major or minor fault for the current process,
+   or, if AROUND is true, a page mapped ahead of a fault.  In
+   that case, P is not loaded if there is no free frame.  P's
+   lock must be held.  Returns true if successful, false
+   otherwise. */
+static bool
+load (struct page *p, bool around)
+{
+  struct page_faults *faults = &thread_current ()->faults;
+  bool text = p->type == PAGE_FILE && !p->writable;
+  enum palloc_flags flags = p->type == PAGE_ZERO ? PAL_ZERO : 0;
+  struct frame *f;
+  uint8_t *kpage;
+
+  ASSERT (lock_held_by_current_thread (&p->lock));
+  ASSERT (p->frame == NULL);
+
+  /* Another process running the same executable may have the
+     page in memory already. */
+  if (text)
+    {
+      f = frame_share_text (p, file_get_inode (p->file), p->ofs,
+                            p->read_bytes);
+      if (f != NULL)
+        {
+          if (!pagedir_set_page (p->pagedir, p->upage, f->kpage, false))
+            {
+              frame_free (f, p);
+              return false;
+            }
+          p->frame = f;
+          if (around)
+            faults->around++;
+          else
+            faults->minor++;
+          return true;
+        }
+    }
+
+  f = around ? frame_try_alloc (p, flags) : frame_alloc (p, flags);
+  if (f == NULL)
+    return false;
+  kpage = f->kpage;
+
+  switch (p->type)
+    {
+    case PAGE_FILE:
+    case PAGE_MMAP:
+      if (file_read_at (p->file, kpage, p->read_bytes, p->ofs)
+          != (off_t) p->read_bytes)
+        {
+          frame_free (f, p);
+          return false;
+        }
+      memset (kpage + p->read_bytes, 0, PGSIZE - p->read_bytes);
+      file_loads++;
+      break;
+
+    case PAGE_ZERO:
+      zero_loads++;
+      break;
+
+    case PAGE_ANON:
+      swap_read (p->swap_slot, kpage);
+      swap_free (p->swap_slot, 1);
+      p->swap_slot = SWAP_ERROR;
+      swap_loads++;
+      break;
+    }
+
+  if (!pagedir_set_page (p->pagedir, p->upage, kpage, p->writable))
+    {
+      frame_free (f, p);
+      return false;
+    }
+  p->frame = f;
+  if (text)
+    frame_set_text (f, file_get_inode (p->file), p->ofs, p->read_bytes);
+  if (around)
+    faults->around++;
+  else if (p->type == PAGE_ZERO)
+    faults->minor++;
+  else
+    faults->major++;
+  return true;
+}
+
+/* Maps pages ahead of UPAGE, at which the current process just
+   faulted, as described at the top of this file. */
+static void
+fault_around (uint8_t *upage)
+{
+  struct page_faults *faults = &thread_current ()->faults;
+  struct fault_stream *s = NULL;
+  size_t i;
+
+  for (i = 0; i < FAULT_STREAMS; i++)
+    if (upage >= faults->streams[i].start && upage <= faults->streams[i].next)
+      {
+        s = &faults->streams[i];
+        break;
+      }
+
+  if (s == NULL)
+    {
+      s = &faults->streams[faults->replace++ % FAULT_STREAMS];
+      s->start = s->next = upage + PGSIZE;
+      s->window = 0;
+      return;
+    }
+
+  if (upage == s->next)
+    s->window = s->window == 0 ? 1 : s->window * 2;
+  else
+    s->window /= 2;
+  if (s->window > FAULT_WINDOW_MAX)
+    s->window = FAULT_WINDOW_MAX;
+
+  s->start = upage + PGSIZE;
+  s->next = s->start + map_ahead (s->start, s->window) * PGSIZE;
+}
+
+/* Loads up to PAGE_CNT pages of the current process starting
+   at UPAGE that are not in memory, stopping early at the end of
+   the region that UPAGE is in or if memory or a page's lock is
+   not free.  Pages in swap are skipped.  Returns the number of
+   pages passed over, whether loaded or not. */
+static size_t
+map_ahead (uint8_t *upage, size_t page_cnt)
+{
+  size_t i;
+
+  for (i = 0; i < page_cnt; i++, upage += PGSIZE)
+    {
+      struct page *p = page_lookup (upage);
+      bool success = true;
+
+      if (p == NULL || !lock_try_acquire (&p->lock))
+        break;
+      if (p->frame == NULL && p->type != PAGE_ANON)
+        success = load (p, true);
+      lock_release (&p->lock);
+      if (!success)
+        break;
+    }
+  return i;
+}
+
+/* Adds a copy of P, a page of the process being forked whose
+   lock is held, to the current process's table, as described
+   for page_table_copy().  Returns true if successful, false if
+   memory is not available. */
+static bool
+copy (struct page *p)
+{
+  struct page *c;
+
+  if (p->type == PAGE_MMAP)
+    {
+      if (p->frame != NULL && pagedir_is_dirty (p->pagedir, p->upage))
+        {
+          file_write_at (p->file, p->frame->kpage, p->read_bytes, p->ofs);
+          pagedir_set_dirty (p->pagedir, p->upage, false);
+        }
+      return true;
+    }
+
+  c = new_page (p->upage, p->type, p->writable);
+  if (c == NULL)
+    return false;
+  c->file = p->type == PAGE_FILE ? thread_current ()->exec_file : NULL;
+  c->ofs = p->ofs;
+  c->read_bytes = p->read_bytes;
+
+  if (p->frame != NULL)
+    {
+      /* Share P's frame. */
+      if (pagedir_is_dirty (p->pagedir, p->upage))
+        p->type = c->type = PAGE_ANON;
+      if (!pagedir_set_page (c->pagedir, c->upage, p->frame->kpage, false))
+        return false;
+      pagedir_set_writable (p->pagedir, p->upage, false);
+      frame_share (p->frame, c);
+      c->frame = p->frame;
+    }
+  else if (p->type == PAGE_ANON)
+    {
+      /* Share P's swap slot. */
+      swap_share (p->swap_slot);
+      c->swap_slot = p->swap_slot;
+    }
+  return true;
+}
+
+/* Makes P, which is in memory and whose lock is held, writable
+   by its process, with a frame of its own.  Returns true if
+   successful, false if memory is not available for a copy. */
+static bool
+unshare (struct page *p)
+{
+  struct frame *f = frame_unshare (p->frame, p);
+
+  if (f == NULL)
+    return false;
+  else if (f == p->frame)
+    pagedir_set_writable (p->pagedir, p->upage, true);
+  else
+    {
+      p->frame = f;
+      pagedir_clear_page (p->pagedir, p->upage);
+      return pagedir_set_page (p->pagedir, p->upage, f->kpage, true);
+    }
+  return true;
+}
+
+/* Returns a hash value for the page that E refers to. */
+static unsigned
+page_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct page *p = hash_entry (e, struct page, elem);
+  return hash_int ((int) pg_no (p->upage));
+}
+
+/* Returns true if the page that A refers to precedes the one
+   that B refers to. */
+static bool
+page_less (const struct hash_elem *a, const struct hash_elem *b,
+           void *aux UNUSED)
+{
+  const struct page *pa = hash_entry (a, struct page, elem);
+  const struct page *pb = hash_entry (b, struct page, elem);
+  return pa->upage < pb->upage;
+}
+
+/* Frees the page that E refers to. */
+static void
+page_free (struct hash_elem *e, void *aux UNUSED)
+{
+  release (hash_entry (e, struct page, elem));
+}
+
+/* Frees P, which is no longer in its table, with its frame or
+   swap slot, writing it back first if it is a PAGE_MMAP page
+   that has been written.  Waits for P's lock, in case it is
+   being evicted. */
+static void
+release (struct page *p)
+{
+  lock_acquire (&p->lock);
+  if (p->frame != NULL)
+    {
+      pagedir_clear_page (p->pagedir, p->upage);
+      if (p->type == PAGE_MMAP && pagedir_is_dirty (p->pagedir, p->upage))
+        file_write_at (p->file, p->frame->kpage, p->read_bytes, p->ofs);
+      frame_free (p->frame, p);
+    }
+  else if (p->swap_slot != SWAP_ERROR)
+    swap_free (p->swap_slot, 1);
+  lock_release (&p->lock);
+
+  kmem_cache_free (&page_cache, p);
+}
@@ -0,0 +1,100 @@
+#ifndef VM_PAGE_H
+#define VM_PAGE_H
+
+#include <hash.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "filesys/off_t.h"
+#include "threads/synch.h"
+
+struct thread;
+
+/* Supplemental page table.
+
+   Each process has a table that records, for every page of its
+   address space, where the page's contents come from, so that a
+   page need not be in memory until the process first touches
+   it.  See page.c for details. */
+
+/* Where a page's contents come from. */
+enum page_type
+  {
+    PAGE_FILE,          /* Read from a file, rest zeroed. */
+    PAGE_ZERO,          /* All zeros. */
+    PAGE_ANON,          /* Anonymous, in swap while evicted. */
+    PAGE_MMAP           /* Mapped file, written back to it. */
+  };
+
+/* A page of a process's address space. */
+struct page
+  {
+    void *upage;                /* User virtual address. */
+    uint32_t *pagedir;          /* Page directory of its process. */
+    struct frame *frame;        /* Frame holding it, or null. */
+    struct list_elem frame_elem; /* Element in frame's `pages'. */
+    enum page_type type;        /* Source of contents. */
+    bool writable;              /* Writable by the process? */
+    struct lock lock;           /* Held while loading or evicting it. */
+    unsigned pin_cnt;           /* Never evicted while nonzero. */
+
+    /* PAGE_FILE and PAGE_MMAP only. */
+    struct file *file;          /* File to read. */
+    off_t ofs;                  /* Offset in file. */
+    size_t read_bytes;          /* Bytes to read; the rest is zeroed. */
+
+    /* PAGE_ANON only. */
+    size_t swap_slot;           /* Swap slot while evicted. */
+
+    struct hash_elem elem;      /* Element in supplemental page table. */
+  };
+
+/* Fault-around.  See page.c for details. */
+#define FAULT_STREAMS 4         /* Fault streams tracked per process. */
+#define FAULT_WINDOW_MAX 16     /* Most pages mapped ahead of a fault. */
+
+/* A run of page faults at increasing addresses. */
+struct fault_stream
+  {
+    uint8_t *start;             /* First page mapped ahead. */
+    uint8_t *next;              /* First page past those. */
+    size_t window;              /* Pages to map ahead next time. */
+  };
+
+/* A process's page fault state and counters. */
+struct page_faults
+  {
+    struct fault_stream streams[FAULT_STREAMS];
+    unsigned replace;           /* Stream to replace next. */
+    long long major;            /* Faults that read a file or swap. */
+    long long minor;            /* Faults that did not. */
+    long long around;           /* Pages mapped ahead of faults. */
+  };
+
+/* Maximum number of pages in a process's stack.  Controlled by
+   kernel command-line option "-stack=COUNT". */
+#define STACK_LIMIT_DEFAULT 2048
+extern size_t page_stack_limit;
+
+void page_init (void);
+bool page_table_create (struct hash *);
+void page_table_destroy (struct hash *);
+bool page_table_copy (struct thread *parent);
+
+bool page_add_file (void *upage, struct file *, off_t ofs,
+                    size_t read_bytes, bool writable);
+bool page_add_zero (void *upage, bool writable);
+bool page_add_mmap (void *upage, struct file *, off_t ofs,
+                    size_t read_bytes);
+void page_remove (void *upage);
+struct page *page_lookup (const void *uaddr);
+bool page_load (const void *uaddr);
+bool page_fault_load (const void *uaddr);
+bool page_grow_stack (const void *uaddr, const void *esp);
+bool page_unshare (const void *uaddr);
+bool page_pin (const void *uaddr, bool write);
+void page_unpin (const void *uaddr);
+
+void page_print_stats (void);
+
+#endif /* vm/page.h */
@@ -0,0 +1,150 @@
+#include "vm/swap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <stdio.h>
+#include "devices/block.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Swap slots.
+
+   `used_map' has a bit for each slot of the swap device.  A
+   slot is allocated when a page is evicted to it and freed as
+   soon as the page is read back in, or when its process exits.
+   A page that several processes share after fork() goes to a
+   single slot for all of them, so each slot also counts the
+   pages that refer to it in `ref_cnts', and swap_free() only
+   frees it when the last of them lets go.
+   The eviction code asks for a run of contiguous slots for all
+   the pages it evicts at once (see frame.c), so that they are
+   written to consecutive sectors of the disk.
+
+   Without a swap device, swap_alloc() always fails, so pages
+   that would have to be written to swap are never evicted. */
+
+/* Number of sectors per slot. */
+#define SECTORS_PER_SLOT (PGSIZE / BLOCK_SECTOR_SIZE)
+
+static struct block *swap_device;
+static struct bitmap *used_map;         /* Allocated slots. */
+static unsigned *ref_cnts;              /* Pages in each slot. */
+static struct lock swap_lock;           /* Protects the above. */
+
+/* Statistics. */
+static long long slots_written;         /* # of slots written. */
+static long long slots_read;            /* # of slots read. */
+static long long runs;                  /* # of multi-slot allocations. */
+
+/* Initializes the swap slots on the swap block device, if there
+   is one. */
+void
+swap_init (void)
+{
+  lock_init (&swap_lock);
+  swap_device = block_get_role (BLOCK_SWAP);
+  if (swap_device == NULL)
+    return;
+
+  used_map = bitmap_create (block_size (swap_device) / SECTORS_PER_SLOT);
+  if (used_map == NULL)
+    PANIC ("swap: bitmap creation failed");
+  ref_cnts = calloc (bitmap_size (used_map), sizeof *ref_cnts);
+  if (ref_cnts == NULL)
+    PANIC ("swap: reference count allocation failed");
+}
+
+/* Allocates CNT contiguous swap slots, each for one page, and
+   returns the first, or SWAP_ERROR if that many are not
+   available together. */
+size_t
+swap_alloc (size_t cnt)
+{
+  size_t slot;
+  size_t i;
+
+  if (used_map == NULL)
+    return SWAP_ERROR;
+
+  lock_acquire (&swap_lock);
+  slot = bitmap_scan_and_flip (used_map, 0, cnt, false);
+  if (slot != BITMAP_ERROR)
+    {
+      for (i = 0; i < cnt; i++)
+        ref_cnts[slot + i] = 1;
+      if (cnt > 1)
+        runs++;
+    }
+  lock_release (&swap_lock);
+
+  return slot != BITMAP_ERROR ? slot : SWAP_ERROR;
+}
+
+/* Records that one more page refers to SLOT, which must be
+   allocated. */
+void
+swap_share (size_t slot)
+{
+  lock_acquire (&swap_lock);
+  ASSERT (bitmap_test (used_map, slot));
+  ref_cnts[slot]++;
+  lock_release (&swap_lock);
+}
+
+/* Drops a page's reference to each of the CNT swap slots
+   starting at SLOT, freeing those that no other page refers
+   to. */
+void
+swap_free (size_t slot, size_t cnt)
+{
+  size_t i;
+
+  lock_acquire (&swap_lock);
+  ASSERT (bitmap_all (used_map, slot, cnt));
+  for (i = slot; i < slot + cnt; i++)
+    if (--ref_cnts[i] == 0)
+      bitmap_reset (used_map, i);
+  lock_release (&swap_lock);
+}
+
+/* Writes the page at KPAGE to SLOT, which must be allocated. */
+void
+swap_write (size_t slot, const void *kpage)
+{
+  const uint8_t *p = kpage;
+  int i;
+
+  ASSERT (bitmap_test (used_map, slot));
+
+  for (i = 0; i < SECTORS_PER_SLOT; i++)
+    block_write (swap_device, slot * SECTORS_PER_SLOT + i,
+                 p + i * BLOCK_SECTOR_SIZE);
+  slots_written++;
+}
+
+/* Reads SLOT, which must be allocated, into the page at KPAGE. */
+void
+swap_read (size_t slot, void *kpage)
+{
+  uint8_t *p = kpage;
+  int i;
+
+  ASSERT (bitmap_test (used_map, slot));
+
+  for (i = 0; i < SECTORS_PER_SLOT; i++)
+    block_read (swap_device, slot * SECTORS_PER_SLOT + i,
+                p + i * BLOCK_SECTOR_SIZE);
+  slots_read++;
+}
+
+/* Prints swap statistics. */
+void
+swap_print_stats (void)
+{
+  if (used_map == NULL)
+    return;
+  printf ("Swap: %zu of %zu slots in use, %lld written "
+          "(%lld multi-slot runs), %lld read\n",
+          bitmap_count (used_map, 0, bitmap_size (used_map), true),
+          bitmap_size (used_map), slots_written, runs, slots_read);
+}
@@ -0,0 +1,24 @@
+#ifndef VM_SWAP_H
+#define VM_SWAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Swap slots.
+
+   The swap block device is divided into page-size slots, which
+   hold the contents of pages evicted from memory that exist
+   nowhere else. */
+
+/* Returned by swap_alloc() when no slots are available. */
+#define SWAP_ERROR SIZE_MAX
+
+void swap_init (void);
+size_t swap_alloc (size_t cnt);
+void swap_share (size_t slot);
+void swap_free (size_t slot, size_t cnt);
+void swap_write (size_t slot, const void *kpage);
+void swap_read (size_t slot, void *kpage);
+void swap_print_stats (void);
+
+#endif /* vm/swap.h */